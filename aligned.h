@@ -0,0 +1,46 @@
+#ifndef BMPANALYZER_ALIGNED_H
+#define BMPANALYZER_ALIGNED_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Allocator returning cache-line aligned storage, so SIMD kernels can start
+// every buffer on an aligned boundary.
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T *pointer, size_t) {
+        ::operator delete(pointer, std::align_val_t(Alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const {
+        return false;
+    }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif //BMPANALYZER_ALIGNED_H
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <iostream>
+#include "asyncwriter.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool writeGathered(const std::string &path, const std::vector<WriteBuffer> &buffers, bool append) {
+    if (append && !std::ifstream(path).is_open()) {
+        return false;
+    }
+    std::ofstream file(path, append ? std::ios::binary | std::ios::app : std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    for (const auto &buffer: buffers) {
+        file.write(static_cast<const char *>(buffer.data), static_cast<std::streamsize>(buffer.size));
+    }
+    return static_cast<bool>(file);
+}
+
+#else
+
+bool writeGathered(const std::string &path, const std::vector<WriteBuffer> &buffers, bool append) {
+    // appending never creates the file, so chunks after a failed start are dropped too
+    int fd = append ? open(path.c_str(), O_WRONLY | O_APPEND) : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<iovec> parts;
+    for (const auto &buffer: buffers) {
+        if (buffer.size > 0) {
+            parts.push_back({const_cast<void *>(buffer.data), buffer.size});
+        }
+    }
+
+    // writev may write less than asked for; continue from wherever it stopped
+    size_t first = 0;
+    while (first < parts.size()) {
+        int count = static_cast<int>(std::min<size_t>(parts.size() - first, IOV_MAX));
+        ssize_t written = writev(fd, parts.data() + first, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        auto remaining = static_cast<size_t>(written);
+        while (first < parts.size() && remaining >= parts[first].iov_len) {
+            remaining -= parts[first].iov_len;
+            ++first;
+        }
+        if (remaining > 0) {
+            parts[first].iov_base = static_cast<uint8_t *>(parts[first].iov_base) + remaining;
+            parts[first].iov_len -= remaining;
+        }
+    }
+    return close(fd) == 0;
+}
+
+#endif
+
+AsyncWriter::AsyncWriter(size_t byteBudget, unsigned threadCount) : byteBudget(byteBudget) {
+    for (unsigned i = 0; i < std::max(1u, threadCount); ++i) {
+        workers.emplace_back(&AsyncWriter::workerLoop, this);
+    }
+}
+
+AsyncWriter::~AsyncWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void AsyncWriter::submit(std::string path, std::vector<uint8_t> header, std::vector<uint8_t> pixels) {
+    enqueue({std::move(path), std::move(header), std::move(pixels), false});
+}
+
+void AsyncWriter::append(std::string path, std::vector<uint8_t> bytes) {
+    enqueue({std::move(path), {}, std::move(bytes), true});
+}
+
+void AsyncWriter::enqueue(Job job) {
+    size_t bytes = job.header.size() + job.pixels.size();
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [&] { return bytesInFlight == 0 || bytesInFlight + bytes <= byteBudget; });
+    bytesInFlight += bytes;
+    ++jobsInFlight;
+    jobs.push_back(std::move(job));
+    jobAvailable.notify_one();
+}
+
+void AsyncWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [&] { return jobsInFlight == 0; });
+}
+
+size_t AsyncWriter::failures() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+// Oldest queued job whose path is neither being written nor waiting behind an
+// earlier job, so the pieces of one file land in order. Called with mutex held.
+std::deque<AsyncWriter::Job>::iterator AsyncWriter::nextRunnable() {
+    std::vector<std::string> blocked = busyPaths;
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if (std::find(blocked.begin(), blocked.end(), it->path) == blocked.end()) {
+            return it;
+        }
+        blocked.push_back(it->path);
+    }
+    return jobs.end();
+}
+
+void AsyncWriter::workerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto next = jobs.end();
+            jobAvailable.wait(lock, [&] {
+                next = nextRunnable();
+                return next != jobs.end() || (stopping && jobs.empty());
+            });
+            if (next == jobs.end()) {
+                return;
+            }
+            job = std::move(*next);
+            jobs.erase(next);
+            busyPaths.push_back(job.path);
+        }
+
+        bool written = writeGathered(job.path, {{job.header.data(), job.header.size()},
+                                                {job.pixels.data(), job.pixels.size()}}, job.append);
+        if (!written) {
+            std::cerr << "Error opening file: " << job.path << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        busyPaths.erase(std::find(busyPaths.begin(), busyPaths.end(), job.path));
+        bytesInFlight -= job.header.size() + job.pixels.size();
+        --jobsInFlight;
+        failed += written ? 0 : 1;
+        progress.notify_all();
+        jobAvailable.notify_all();
+    }
+}
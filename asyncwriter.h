@@ -0,0 +1,77 @@
+#ifndef BMPANALYZER_ASYNCWRITER_H
+#define BMPANALYZER_ASYNCWRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct WriteBuffer {
+    const void *data;
+    size_t size;
+};
+
+// Replaces path with the concatenation of buffers in a single gathered write
+// (writev on POSIX), or adds them to the end of an existing file when append
+// is set. Returns false if the file could not be written.
+bool writeGathered(const std::string &path, const std::vector<WriteBuffer> &buffers, bool append = false);
+
+// Queue of files written by background threads, so callers keep computing
+// while earlier results flush. submit blocks while more than byteBudget bytes
+// are queued or being written; a single larger file is still accepted alone.
+// Jobs for the same path are written in submission order, one at a time.
+class AsyncWriter {
+public:
+    explicit AsyncWriter(size_t byteBudget = size_t{256} << 20, unsigned threadCount = 1);
+
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter &) = delete;
+
+    AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+    // Queues header followed by pixels as one file; both buffers are owned by the writer.
+    void submit(std::string path, std::vector<uint8_t> header, std::vector<uint8_t> pixels);
+
+    // Queues bytes to be added to the end of path after everything queued for it
+    // before, so a file can be produced in bounded chunks after a submit.
+    void append(std::string path, std::vector<uint8_t> bytes);
+
+    // Waits until every submitted file has been written.
+    void flush();
+
+    // Number of files or appended chunks that could not be written so far.
+    size_t failures() const;
+
+private:
+    struct Job {
+        std::string path;
+        std::vector<uint8_t> header;
+        std::vector<uint8_t> pixels;
+        bool append;
+    };
+
+    void enqueue(Job job);
+
+    std::deque<Job>::iterator nextRunnable();
+
+    void workerLoop();
+
+    size_t byteBudget;
+    size_t bytesInFlight = 0;
+    size_t jobsInFlight = 0;
+    size_t failed = 0;
+    bool stopping = false;
+    std::deque<Job> jobs;
+    std::vector<std::string> busyPaths;
+    mutable std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable progress;
+    std::vector<std::thread> workers;
+};
+
+#endif //BMPANALYZER_ASYNCWRITER_H
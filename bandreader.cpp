@@ -0,0 +1,137 @@
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "bandreader.h"
+#include "bmp.h"
+#include "colorconvert.h"
+
+namespace {
+    const size_t fileHeaderSize = 14;
+    const size_t infoHeaderSize = 40;
+
+    // Reads size bytes, true only if all of them arrived.
+    bool readExactly(std::ifstream &file, uint8_t *data, size_t size) {
+        file.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(size));
+        std::streamsize count = file.gcount();
+        return count >= 0 && static_cast<size_t>(count) == size;
+    }
+
+    template<typename T>
+    T readField(const std::vector<uint8_t> &bytes, size_t offset) {
+        T value;
+        std::memcpy(&value, bytes.data() + offset, sizeof(T));
+        return value;
+    }
+
+    StatsAccumulator accumulateStats(const std::string &filename, int bandRows) {
+        BandReader reader(filename, bandRows);
+        StatsAccumulator stats;
+        RowBand band;
+
+        while (reader.next(band)) {
+            stats.update(band.view());
+        }
+        return stats;
+    }
+}
+
+BandReader::BandReader(const std::string &filename, int bandRows) : bandRows(bandRows) {
+    if (bandRows <= 0) {
+        throw std::runtime_error("Band size must be positive");
+    }
+
+    file.open(filename, std::ios::binary | std::ios::in);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error opening file");
+    }
+
+    header.resize(fileHeaderSize + infoHeaderSize);
+    if (!readExactly(file, header.data(), header.size()) || readField<uint16_t>(header, 0) != 0x4D42) {
+        throw std::runtime_error("Invalid BMP file");
+    }
+
+    auto offBits = readField<uint32_t>(header, 10);
+    auto bitCount = readField<uint16_t>(header, fileHeaderSize + 14);
+    if (bitCount != 24) {
+        throw std::runtime_error("Only 24-bit BMP files are supported");
+    }
+    if (offBits < header.size()) {
+        throw std::runtime_error("Invalid BMP file");
+    }
+
+    imageWidth = readField<int32_t>(header, fileHeaderSize + 4);
+    int32_t height = readField<int32_t>(header, fileHeaderSize + 8);
+    if (imageWidth <= 0 || height == 0 || height == INT32_MIN) {
+        throw std::runtime_error("Invalid BMP file");
+    }
+    isBottomUp = height > 0;
+    imageHeight = std::abs(height);
+    rowStride = (static_cast<size_t>(imageWidth) * 3 + 3) / 4 * 4;
+
+    // keep the palette (or extended header) so writers can reproduce the file layout
+    size_t headerSize = header.size();
+    header.resize(offBits);
+    if (!readExactly(file, header.data() + headerSize, offBits - headerSize)) {
+        throw std::runtime_error("Invalid BMP file");
+    }
+}
+
+bool BandReader::next(RowBand &band) {
+    if (nextRow >= imageHeight) {
+        return false;
+    }
+
+    band.firstRow = nextRow;
+    band.rows = std::min(bandRows, imageHeight - nextRow);
+    band.width = imageWidth;
+    band.height = imageHeight;
+    band.stride = rowStride;
+    band.bottomUp = isBottomUp;
+    band.data.resize(band.rows * rowStride);
+
+    if (!readExactly(file, band.data.data(), band.data.size())) {
+        throw std::runtime_error("Unexpected end of BMP file");
+    }
+
+    nextRow += band.rows;
+    return true;
+}
+
+ChannelStats streamStats(const std::string &filename, int bandRows) {
+    return accumulateStats(filename, bandRows).finalize();
+}
+
+double streamMathExp(const std::string &filename, char component, int bandRows) {
+    return streamStats(filename, bandRows).meanOf(component);
+}
+
+double streamStandardDeviation(const std::string &filename, char component, int bandRows) {
+    return streamStats(filename, bandRows).standardDeviationOf(component);
+}
+
+double streamCorrelCoef(const std::string &filename, char component1, char component2, int bandRows) {
+    return streamStats(filename, bandRows).correlationOf(component1, component2);
+}
+
+void streamRGBToYCbCr(const std::string &filename, const std::string &outFilename, int bandRows) {
+    BandReader reader(filename, bandRows);
+
+    std::ofstream file(outFilename + ".bmp", std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error opening file: " + outFilename);
+    }
+    file.write(reinterpret_cast<const char *>(reader.headerBytes().data()), reader.headerBytes().size());
+
+    RowBand band;
+    std::vector<uint8_t> converted;
+    while (reader.next(band)) {
+        // padding bytes stay zero, pixels are converted in place of the source layout
+        converted.assign(band.data.size(), 0);
+        for (int i = 0; i < band.rows; ++i) {
+            const uint8_t *source = band.row(i);
+            uint8_t *destination = converted.data() + i * band.stride;
+            convertRGBToYCbCrPixels(source, destination, band.width);
+        }
+        file.write(reinterpret_cast<const char *>(converted.data()), converted.size());
+    }
+}
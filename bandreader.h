@@ -0,0 +1,86 @@
+#ifndef BMPANALYZER_BANDREADER_H
+#define BMPANALYZER_BANDREADER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "imageview.h"
+#include "stats.h"
+
+// A group of consecutive rows exactly as they are stored in the file,
+// including the 4-byte row padding.
+struct RowBand {
+    std::vector<uint8_t> data;
+    int firstRow = 0; // index of the first stored row in file order
+    int rows = 0;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0;
+    bool bottomUp = true;
+
+    const uint8_t *row(int i) const {
+        return data.data() + i * stride;
+    }
+
+    ImageView view() const {
+        return {data.data(), static_cast<size_t>(width), static_cast<size_t>(rows), stride};
+    }
+
+    // Top-down image row of the i-th stored row of the band.
+    int imageRow(int i) const {
+        return bottomUp ? height - 1 - (firstRow + i) : firstRow + i;
+    }
+};
+
+// Reads a 24-bit BMP band by band in file order, so only bandRows rows
+// are ever held in memory.
+class BandReader {
+public:
+    explicit BandReader(const std::string &filename, int bandRows = 256);
+
+    bool next(RowBand &band);
+
+    int width() const {
+        return imageWidth;
+    }
+
+    int height() const {
+        return imageHeight;
+    }
+
+    size_t stride() const {
+        return rowStride;
+    }
+
+    bool bottomUp() const {
+        return isBottomUp;
+    }
+
+    // Raw file header, info header and palette, everything before the pixels.
+    const std::vector<uint8_t> &headerBytes() const {
+        return header;
+    }
+
+private:
+    std::ifstream file;
+    std::vector<uint8_t> header;
+    int bandRows;
+    int imageWidth = 0;
+    int imageHeight = 0;
+    size_t rowStride = 0;
+    bool isBottomUp = true;
+    int nextRow = 0;
+};
+
+ChannelStats streamStats(const std::string &filename, int bandRows = 256);
+
+double streamMathExp(const std::string &filename, char component, int bandRows = 256);
+
+double streamStandardDeviation(const std::string &filename, char component, int bandRows = 256);
+
+double streamCorrelCoef(const std::string &filename, char component1, char component2, int bandRows = 256);
+
+void streamRGBToYCbCr(const std::string &filename, const std::string &outFilename, int bandRows = 256);
+
+#endif //BMPANALYZER_BANDREADER_H
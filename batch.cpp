@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "batch.h"
+#include "bmp.h"
+#include "threadpool.h"
+
+namespace {
+    struct LoadedImage {
+        size_t index = 0;
+        std::unique_ptr<BMP> image;
+        std::string error;
+    };
+
+    const char *csvHeader = "file,width,height,"
+                            "meanR,meanG,meanB,deviationR,deviationG,deviationB,"
+                            "correlRG,correlRB,correlGB,entropyR,entropyG,entropyB,"
+                            "correlYCb,correlYCr,correlCbCr,psnrR,psnrG,psnrB,error";
+
+    std::string quoted(const std::string &field) {
+        std::string result = "\"";
+        for (char c: field) {
+            result += c;
+            if (c == '"') {
+                result += '"';
+            }
+        }
+        return result + "\"";
+    }
+
+    std::string analyse(const std::string &file, BMP &bmp) {
+        auto data = bmp.getData();
+        auto rgbStats = bmp.countStats(data);
+        auto histograms = bmp.countHistograms(data);
+        auto yCbCr = bmp.convertRGBToYCbCr();
+        auto yCbCrStats = bmp.countStats(yCbCr);
+        auto rgb = bmp.convertYbCrToRGB(yCbCr);
+        auto errors = bmp.countErrors(data, rgb);
+
+        std::ostringstream row;
+        row << quoted(file) << ',' << bmp.width() << ',' << bmp.height();
+        for (char c: {'r', 'g', 'b'}) {
+            row << ',' << rgbStats.meanOf(c);
+        }
+        for (char c: {'r', 'g', 'b'}) {
+            row << ',' << rgbStats.standardDeviationOf(c);
+        }
+        row << ',' << rgbStats.correlationOf('r', 'g') << ',' << rgbStats.correlationOf('r', 'b')
+            << ',' << rgbStats.correlationOf('g', 'b');
+        for (char c: {'r', 'g', 'b'}) {
+            row << ',' << histograms.channel[getIndexComponent(c)].entropy();
+        }
+        row << ',' << yCbCrStats.correlationOf('Y', 'B') << ',' << yCbCrStats.correlationOf('Y', 'R')
+            << ',' << yCbCrStats.correlationOf('B', 'R');
+        for (char c: {'r', 'g', 'b'}) {
+            row << ',' << errors.psnrOf(c);
+        }
+        row << ',';
+        return row.str();
+    }
+
+    std::string errorRow(const std::string &file, const std::string &error) {
+        return quoted(file) + std::string(21, ',') + quoted(error);
+    }
+
+    const char *indexHeader = "file,width,height,bitCount,compression,dataOffset,fileSize,imageSize,error";
+
+    std::string indexRow(const std::string &file) {
+        std::ostringstream row;
+        row << quoted(file);
+        try {
+            BmpInfo info = BMP::probe(file);
+            row << ',' << info.width << ',' << info.height << ',' << info.bitCount << ',' << info.compression
+                << ',' << info.dataOffset << ',' << info.fileSize << ',' << info.imageSize << ',';
+        } catch (const std::exception &e) {
+            row << std::string(8, ',') << quoted(e.what());
+        }
+        return row.str();
+    }
+
+    // Files probed per parallel block; opening files dominates, so blocks overlap their latency.
+    const size_t indexBlock = 4096;
+
+    bool hasBmpExtension(const std::filesystem::path &path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".bmp";
+    }
+}
+
+std::vector<std::string> collectBatchInputs(const std::string &path) {
+    std::vector<std::string> files;
+    if (std::filesystem::is_directory(path)) {
+        for (const auto &entry: std::filesystem::directory_iterator(path)) {
+            if (entry.is_regular_file() && hasBmpExtension(entry.path())) {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    std::ifstream list(path);
+    if (!list.is_open()) {
+        throw std::runtime_error("Error opening file list: " + path);
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            files.push_back(line);
+        }
+    }
+    return files;
+}
+
+// Reader threads load files into a bounded queue while the analysis threads
+// drain it, so disk and CPU work overlap. Rows are written in input order as
+// soon as every earlier row is done.
+void runBatch(const std::vector<std::string> &files, std::ostream &out, const BatchOptions &options) {
+    unsigned jobs = std::max(1u, options.jobs);
+    unsigned readers = std::max(1u, options.readers);
+    size_t prefetch = options.prefetch > 0 ? options.prefetch : 2 * jobs;
+
+    std::mutex mutex;
+    std::condition_variable spaceAvailable;
+    std::condition_variable imageAvailable;
+    std::deque<LoadedImage> loaded;
+    size_t inFlight = 0; // reserved by readers and not yet taken by the analysis
+    unsigned finishedReaders = 0;
+    std::atomic<size_t> nextFile{0};
+
+    std::vector<std::string> rows(files.size());
+    std::vector<bool> rowDone(files.size());
+    size_t nextRow = 0;
+
+    out << csvHeader << '\n';
+
+    auto readerLoop = [&] {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                spaceAvailable.wait(lock, [&] { return inFlight < prefetch; });
+                ++inFlight;
+            }
+            size_t index = nextFile++;
+            if (index >= files.size()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                --inFlight;
+                break;
+            }
+
+            LoadedImage item;
+            item.index = index;
+            try {
+                item.image = std::make_unique<BMP>(files[index]);
+            } catch (const std::exception &e) {
+                item.error = e.what();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.push_back(std::move(item));
+            imageAvailable.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        ++finishedReaders;
+        spaceAvailable.notify_all();
+        imageAvailable.notify_all();
+    };
+
+    auto workerLoop = [&] {
+        for (;;) {
+            LoadedImage item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                imageAvailable.wait(lock, [&] { return !loaded.empty() || finishedReaders == readers; });
+                if (loaded.empty()) {
+                    break;
+                }
+                item = std::move(loaded.front());
+                loaded.pop_front();
+                --inFlight;
+                spaceAvailable.notify_one();
+            }
+
+            const std::string &file = files[item.index];
+            std::string row;
+            if (item.image) {
+                try {
+                    row = analyse(file, *item.image);
+                } catch (const std::exception &e) {
+                    row = errorRow(file, e.what());
+                }
+                item.image.reset();
+            } else {
+                row = errorRow(file, item.error);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            rows[item.index] = std::move(row);
+            rowDone[item.index] = true;
+            for (; nextRow < files.size() && rowDone[nextRow]; ++nextRow) {
+                out << rows[nextRow] << '\n';
+                std::string().swap(rows[nextRow]);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < readers; ++i) {
+        threads.emplace_back(readerLoop);
+    }
+    for (unsigned i = 0; i < jobs; ++i) {
+        threads.emplace_back(workerLoop);
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    out.flush();
+}
+
+void writeIndex(const std::vector<std::string> &files, std::ostream &out) {
+    out << indexHeader << '\n';
+    std::vector<std::string> rows;
+    for (size_t first = 0; first < files.size(); first += indexBlock) {
+        rows.resize(std::min(indexBlock, files.size() - first));
+        ThreadPool::instance().parallelFor(rows.size(), [&](size_t i) {
+            rows[i] = indexRow(files[first + i]);
+        });
+        for (const auto &row: rows) {
+            out << row << '\n';
+        }
+    }
+    out.flush();
+}
@@ -0,0 +1,27 @@
+#ifndef BMPANALYZER_BATCH_H
+#define BMPANALYZER_BATCH_H
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct BatchOptions {
+    unsigned jobs = 1;     // threads analysing images
+    unsigned readers = 2;  // threads loading files ahead of the analysis
+    size_t prefetch = 0;   // images loaded but not yet analysed, 2 * jobs if 0
+};
+
+// The .bmp files of a directory sorted by name, or the paths listed one per
+// line in a text file, in file order.
+std::vector<std::string> collectBatchInputs(const std::string &path);
+
+// Analyses every file and writes a CSV header plus one row per image to out,
+// in the order of files. Unreadable images get a row with the error message.
+void runBatch(const std::vector<std::string> &files, std::ostream &out, const BatchOptions &options);
+
+// Writes a CSV index with the header fields of every file (see BMP::probe).
+// No pixels are read, so a corpus is scanned at about the speed of opening it.
+void writeIndex(const std::vector<std::string> &files, std::ostream &out);
+
+#endif //BMPANALYZER_BATCH_H
@@ -0,0 +1,328 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "bmp.h"
+#include "chroma.h"
+#include "colorconvert.h"
+#include "integralimage.h"
+#include "pixelformat.h"
+#include "planarimage.h"
+
+namespace {
+    struct Size {
+        const char *name;
+        int width;
+        int height;
+    };
+
+    std::vector<uint8_t> randomPixels(size_t bytes) {
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> distribution(0, 255);
+        std::vector<uint8_t> data(bytes);
+        for (auto &value: data) {
+            value = static_cast<uint8_t>(distribution(generator));
+        }
+        return data;
+    }
+
+    // Large images are timed fewer times so a full run stays in minutes.
+    int repeats = 5;
+
+    // Best of several runs, in seconds; setup runs before each run and is not timed.
+    double measure(const std::function<void()> &setup, const std::function<void()> &function) {
+        double best = 1e30;
+        for (int i = 0; i < repeats; ++i) {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            function();
+            auto stop = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(stop - start).count());
+        }
+        return best;
+    }
+
+    double measure(const std::function<void()> &function) {
+        return measure([] {}, function);
+    }
+
+    // bytes is the pixel data read by one run, three bytes per pixel unless given.
+    void report(const std::string &name, const Size &size, double seconds, double bytes = 0) {
+        double pixels = static_cast<double>(size.width) * size.height;
+        if (bytes == 0) {
+            bytes = pixels * 3;
+        }
+        std::cout << std::left << std::setw(28) << name << std::setw(6) << size.name
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << seconds * 1e9 / pixels << " ns/pix"
+                  << std::setw(10) << bytes / seconds / 1e9 << " GB/s"
+                  << std::setprecision(1) << std::setw(10) << seconds * 1e3 << " ms\n";
+    }
+
+    // Pixels that stay constant over blocks of 32x8, like flat regions of a scan.
+    std::vector<uint8_t> blockPixels(const Size &size, size_t stride) {
+        std::vector<uint8_t> pixels(stride * size.height);
+        for (size_t y = 0; y < static_cast<size_t>(size.height); ++y) {
+            for (size_t x = 0; x < static_cast<size_t>(size.width) * 3; ++x) {
+                pixels[y * stride + x] = static_cast<uint8_t>((x / 96 * 37 + y / 8 * 11 + x % 3 * 71) & 0xFF);
+            }
+        }
+        return pixels;
+    }
+
+    // Writes a bottom-up 24-bit BMP of random (or block) pixels.
+    void writeBmp(const std::string &filename, const Size &size, bool blocks = false) {
+        size_t stride = (static_cast<size_t>(size.width) * 3 + 3) / 4 * 4;
+        auto pixels = blocks ? blockPixels(size, stride) : randomPixels(stride * size.height);
+
+        uint8_t header[54] = {'B', 'M'};
+        auto put = [&header](size_t offset, uint32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                header[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        };
+        put(2, static_cast<uint32_t>(sizeof(header) + pixels.size()));
+        put(10, sizeof(header));
+        put(14, 40);
+        put(18, size.width);
+        put(22, size.height);
+        header[26] = 1;
+        header[28] = 24;
+        put(34, static_cast<uint32_t>(pixels.size()));
+
+        std::ofstream file(filename, std::ios::binary);
+        file.write(reinterpret_cast<char *>(header), sizeof(header));
+        file.write(reinterpret_cast<char *>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+    }
+
+    void benchmarkBmp(const Size &size) {
+        const std::string filename = std::string("bench") + size.name + ".bmp";
+        writeBmp(filename, size);
+
+        BMP bmp;
+        report("BMP load stream", size, measure([&] { bmp = BMP(filename); }));
+        report("BMP load map", size, measure([&] { BMP mapped(filename, LoadMode::Map); }));
+        report("saveFile", size, measure([&] { bmp.saveFile("save"); }));
+
+        report("getRComponent", size, measure([&] { bmp.getRComponent(); }));
+        report("getGComponent", size, measure([&] { bmp.getGComponent(); }));
+        report("getBComponent", size, measure([&] { bmp.getBComponent(); }));
+        report("saveFileComponent", size, measure([&] { bmp.saveFileComponent("component", 'r'); }));
+
+        auto data = bmp.getData();
+        report("countMathExp", size, measure([&] { bmp.countMathExp('r', data); }), data.size() / 3.0);
+        report("countStandardDeviation", size, measure([&] { bmp.countStandardDeviation('g', data); }),
+               data.size() / 3.0);
+        report("countCorrelCoef", size, measure([&] { bmp.countCorrelCoef('r', 'b', data); }),
+               data.size() * 2 / 3.0);
+        report("countEntropy", size, measure([&] { bmp.countEntropy('b', data); }), data.size() / 3.0);
+        report("countHistograms", size, measure([&] { bmp.countHistograms(data); }));
+        report("countStats", size, measure([&] { bmp.countStats(data); }));
+
+        std::vector<uint8_t> yCbCr;
+        std::vector<uint8_t> rgb;
+        report("convertRGBToYCbCr", size, measure([&] { yCbCr = bmp.convertRGBToYCbCr(); }));
+        report("convertYbCrToRGB", size, measure([&] { rgb = bmp.convertYbCrToRGB(yCbCr); }));
+        report("countPSNR", size, measure([&] { bmp.countPSNR(data, rgb, 'g'); }), data.size() * 2.0);
+        report("countErrors", size, measure([&] { bmp.countErrors(data, rgb); }), data.size() * 2.0);
+        report("countSSIM", size, measure([&] { bmp.countSSIM(data, rgb, 'g'); }), data.size() * 2 / 3.0);
+        report("countMSSSIM", size, measure([&] { bmp.countMSSSIM(data, rgb, 'g'); }), data.size() * 2 / 3.0);
+
+        BMP work;
+        report("decimateImageEven", size, measure([&] { work = bmp; }, [&] { work.decimateImageEven(2); }));
+        report("decimateImageAvg", size, measure([&] { work = bmp; }, [&] { work.decimateImageAvg(); }));
+        report("decimateImageBox 2x2", size, measure([&] { work = bmp; }, [&] { work.decimateImageBox(2, 2); }));
+        report("decimateImageBox 3x3", size, measure([&] { work = bmp; }, [&] { work.decimateImageBox(3, 3); }));
+
+        BMP decimated = bmp;
+        decimated.decimateImageEven(2);
+        report("restoreImage", size, measure([&] { work = decimated; }, [&] { work.restoreImage(2); }));
+        for (ResampleFilter filter: {ResampleFilter::Bilinear, ResampleFilter::Bicubic, ResampleFilter::Lanczos3}) {
+            report(std::string("restoreImage ") + resampleFilterName(filter), size,
+                   measure([&] { work = decimated; }, [&] { work.restoreImage(2, filter); }));
+        }
+        report("resizeImage Lanczos3 0.7x", size, measure([&] { work = bmp; }, [&] {
+            work.resizeImage(size.width * 7 / 10, size.height * 7 / 10, ResampleFilter::Lanczos3);
+        }));
+
+        std::filesystem::remove(filename);
+    }
+
+    void benchmarkColorConversion(const Size &size) {
+        size_t pixels = static_cast<size_t>(size.width) * size.height;
+        auto source = randomPixels(pixels * 3);
+        std::vector<uint8_t> converted(pixels * 3);
+        std::vector<uint8_t> reference(pixels * 3);
+
+        report(std::string("RGB->YCbCr ") + colorConvertIsa(), size, measure([&] {
+            convertRGBToYCbCrPixels(source.data(), converted.data(), pixels);
+        }));
+        report("RGB->YCbCr scalar", size, measure([&] {
+            convertRGBToYCbCrScalar(source.data(), reference.data(), pixels);
+        }));
+        if (converted != reference) {
+            std::cout << "  mismatch between SIMD and scalar RGB->YCbCr\n";
+        }
+
+        report(std::string("YCbCr->RGB ") + colorConvertIsa(), size, measure([&] {
+            convertYCbCrToRGBPixels(source.data(), converted.data(), pixels);
+        }));
+        report("YCbCr->RGB scalar", size, measure([&] {
+            convertYCbCrToRGBScalar(source.data(), reference.data(), pixels);
+        }));
+        if (converted != reference) {
+            std::cout << "  mismatch between SIMD and scalar YCbCr->RGB\n";
+        }
+    }
+
+    // RLE8 component files against uncompressed ones, on an image with flat regions.
+    void benchmarkRle(const Size &size) {
+        const std::string filename = std::string("blocks") + size.name + ".bmp";
+        writeBmp(filename, size, true);
+        BMP bmp(filename);
+
+        report("component raw save", size, measure([&] { bmp.saveFileComponent("raw", 'g'); }));
+        report("component RLE8 save", size, measure([&] {
+            bmp.saveFileComponent("rle", 'g', Encoding::Rle8);
+        }));
+        report("component raw load", size, measure([&] { BMP loaded("raw.bmp"); }));
+        report("component RLE8 load", size, measure([&] { BMP loaded("rle.bmp"); }));
+        std::cout << "  RLE8 file is " << std::setprecision(2)
+                  << 100.0 * std::filesystem::file_size("rle.bmp") / std::filesystem::file_size("raw.bmp")
+                  << "% of the uncompressed one\n";
+
+        std::filesystem::remove(filename);
+    }
+
+    void benchmarkDecode(const Size &size) {
+        size_t width = size.width;
+        size_t stride = width * 3;
+        std::vector<uint8_t> decoded(stride * size.height);
+
+        struct Case {
+            const char *name;
+            uint16_t bitCount;
+            uint32_t compression;
+            uint32_t masks[3];
+        };
+        const Case cases[] = {{"decode indexed 8", 8, compressionRgb, {}},
+                              {"decode 565", 16, compressionBitFields, {0xF800, 0x07E0, 0x001F}},
+                              {"decode 444 masks", 16, compressionBitFields, {0x0F00, 0x00F0, 0x000F}},
+                              {"decode BGRX 32", 32, compressionRgb, {}},
+                              {"decode RGBX masks", 32, compressionBitFields, {0xFF000000, 0xFF0000, 0xFF00}}};
+        for (const auto &test: cases) {
+            PixelFormat format;
+            format.bitCount = test.bitCount;
+            format.compression = test.compression;
+            std::memcpy(format.masks, test.masks, sizeof(format.masks));
+            format.colors = randomPixels(256 * 4);
+            size_t sourceStride = (width * test.bitCount + 31) / 32 * 4;
+            auto source = randomPixels(sourceStride * size.height);
+
+            report(test.name, size, measure([&] {
+                decodeToBgr24(format, source.data(), sourceStride, decoded.data(), stride, width, size.height);
+            }), static_cast<double>(source.size()));
+        }
+    }
+
+    void benchmarkPlanar(const Size &size) {
+        size_t stride = static_cast<size_t>(size.width) * 3;
+        auto source = randomPixels(stride * size.height);
+        std::vector<uint8_t> interleaved(source.size());
+        PlanarImage planar;
+        PlanarImage converted;
+
+        report("deinterleave", size, measure([&] {
+            planar = PlanarImage::deinterleave(source.data(), size.width, size.height, stride);
+        }));
+        report("interleave", size, measure([&] {
+            planar.interleave(interleaved.data(), stride);
+        }));
+        report("planar RGB->YCbCr", size, measure([&] {
+            converted = planar.convertRGBToYCbCr();
+        }));
+        report("planar YCbCr->RGB", size, measure([&] {
+            converted = planar.convertYCbCrToRGB();
+        }));
+        report("planar stats", size, measure([&] {
+            planar.countStats();
+        }));
+
+        ImageView image(source.data(), size.width, size.height, stride);
+        SubsampledImage subsampled;
+        report("subsample 4:2:0", size, measure([&] {
+            subsampled = SubsampledImage::subsample(image, chroma420);
+        }));
+        report("upsample 4:2:0", size, measure([&] {
+            subsampled.upsample(MutableImageView(interleaved.data(), size.width, size.height, stride));
+        }));
+    }
+
+    // Statistics of many small regions: cropping and summing each one against
+    // one summed-area table. The table takes 72 bytes per pixel, so it is only
+    // built for images up to 4K.
+    void benchmarkRegions(const Size &size) {
+        if (static_cast<size_t>(size.width) * size.height > 3840 * 2160) {
+            return;
+        }
+        size_t pixels = static_cast<size_t>(size.width) * size.height;
+        auto data = randomPixels(pixels * 3);
+        ImageView image(data.data(), size.width, size.height, static_cast<size_t>(size.width) * 3);
+
+        std::mt19937 generator(7);
+        std::vector<Region> regions(10000);
+        for (auto &region: regions) {
+            region.width = std::uniform_int_distribution<size_t>(1, std::min(256, size.width))(generator);
+            region.height = std::uniform_int_distribution<size_t>(1, std::min(256, size.height))(generator);
+            region.x = std::uniform_int_distribution<size_t>(0, size.width - region.width)(generator);
+            region.y = std::uniform_int_distribution<size_t>(0, size.height - region.height)(generator);
+        }
+
+        report("10000 ROIs by crop", size, measure([&] {
+            for (const auto &region: regions) {
+                StatsAccumulator stats;
+                stats.update(image.crop(region.x, region.y, region.width, region.height));
+                stats.finalize();
+            }
+        }));
+        IntegralImage integral;
+        report("IntegralImage build", size, measure([&] { integral = IntegralImage(image); }));
+        report("10000 ROIs by table", size, measure([&] { integral.stats(regions); }));
+    }
+}
+
+// Usage: BmpBenchmark [size...], sizes among 512, 4K, 8K and 16K (all by default).
+int main(int argc, char *argv[]) {
+    const Size sizes[] = {{"512", 512, 512}, {"4K", 3840, 2160},
+                          {"8K", 7680, 4320}, {"16K", 15360, 8640}};
+
+    // the BMP methods write their results relative to the working directory
+    auto directory = std::filesystem::temp_directory_path() / "bmp-benchmark";
+    std::filesystem::create_directories(directory / "RGB");
+    std::filesystem::current_path(directory);
+
+    for (const auto &size: sizes) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            selected = selected || std::strcmp(argv[i], size.name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        repeats = static_cast<size_t>(size.width) * size.height > 32000000 ? 2 : 5;
+
+        benchmarkBmp(size);
+        benchmarkRle(size);
+        benchmarkDecode(size);
+        benchmarkColorConversion(size);
+        benchmarkPlanar(size);
+        benchmarkRegions(size);
+    }
+    std::filesystem::remove_all(directory);
+}
@@ -1,10 +1,59 @@
+#include <cctype>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <complex>
+#include <cstring>
+#include "asyncwriter.h"
 #include "bmp.h"
+#include "colorconvert.h"
+#include "imagesink.h"
+#include "mappedfile.h"
+#include "pixelformat.h"
+#include "rle.h"
+#include "threadpool.h"
+
+namespace {
+    // Every later use of the headers divides by the row stride or takes the
+    // absolute height, so images without pixels are rejected when read.
+    bool validDimensions(int32_t width, int32_t height, uint16_t bitCount) {
+        return width > 0 && height != 0 && height != INT32_MIN && bitCount != 0;
+    }
+}
+
+BMP::BMP(const std::string &filename, LoadMode mode) {
+    if (mode == LoadMode::Map) {
+        auto file = std::make_shared<const MappedFile>(filename);
+
+        if (file->size() < sizeof(fileHeader) + sizeof(fileInfoHeader)) {
+            throw std::runtime_error("Invalid BMP file");
+        }
+        std::memcpy(&fileHeader, file->data(), sizeof(fileHeader));
+
+        if (fileHeader.bfType != 0x4D42) {
+            throw std::runtime_error("Invalid BMP file");
+        }
+
+        std::memcpy(&fileInfoHeader, file->data() + sizeof(fileHeader), sizeof(fileInfoHeader));
+
+        if (fileHeader.bfOffBits < sizeof(fileInfoHeader) + sizeof(fileHeader) || fileHeader.bfOffBits > file->size() ||
+            !validDimensions(fileInfoHeader.biWidth, fileInfoHeader.biHeight, fileInfoHeader.biBitCount)) {
+            throw std::runtime_error("Invalid BMP file");
+        }
+        const uint8_t *paletteBegin = file->data() + sizeof(fileHeader) + sizeof(fileInfoHeader);
+        palette.assign(paletteBegin, file->data() + fileHeader.bfOffBits);
+
+        mappedData = file->data() + fileHeader.bfOffBits;
+        mappedSize = std::min(imageSize(), file->size() - fileHeader.bfOffBits);
+        mapping = std::move(file);
+
+        // other formats are decoded into owned pixels, which drops the mapping
+        if (fileInfoHeader.biBitCount != 24 || fileInfoHeader.biCompression != compressionRgb) {
+            decodePixels(mappedData, mappedSize);
+        }
+        return;
+    }
 
-BMP::BMP(const std::string &filename) {
     std::ifstream file(filename, std::ios::binary | std::ios::in);
 
     if (!file.is_open()) {
@@ -19,38 +68,205 @@ BMP::BMP(const std::string &filename) {
 
     file.read(reinterpret_cast<char *>(&fileInfoHeader), sizeof(fileInfoHeader));
 
+    if (!file || fileHeader.bfOffBits < sizeof(fileInfoHeader) + sizeof(fileHeader) ||
+        !validDimensions(fileInfoHeader.biWidth, fileInfoHeader.biHeight, fileInfoHeader.biBitCount)) {
+        throw std::runtime_error("Invalid BMP file");
+    }
     palette.resize(fileHeader.bfOffBits - sizeof(fileInfoHeader) - sizeof(fileHeader));
     file.read(reinterpret_cast<char *>(palette.data()), palette.size());
 
 
-    if (fileInfoHeader.biBitCount != 24) {
-        throw std::runtime_error("Only 24-bit BMP files are supported");
-    }
-
-    imageData.resize(fileInfoHeader.biSizeImage + fileHeader.bfOffBits);
+    imageData.resize(imageSize());
     file.read(reinterpret_cast<char *>(imageData.data()), imageData.size());
+    imageData.resize(file.gcount());
 
     file.close();
+
+    if (fileInfoHeader.biBitCount != 24 || fileInfoHeader.biCompression != compressionRgb) {
+        std::vector<uint8_t> raw = std::move(imageData);
+        decodePixels(raw.data(), raw.size());
+    }
 }
 
-void BMP::saveFile(const std::string &filename) {
-    std::ofstream file(filename + ".bmp", std::ios::binary);
+void BMP::decodePixels(const uint8_t *data, size_t size) {
+    PixelFormat format;
+    format.bitCount = fileInfoHeader.biBitCount;
+    format.compression = fileInfoHeader.biCompression;
+
+    // bit-field masks follow the 40-byte info header, inside larger headers or after it;
+    // the colour table follows the complete header
+    if (format.compression == compressionBitFields || format.compression == compressionAlphaBitFields) {
+        if (palette.size() < sizeof(format.masks)) {
+            throw std::runtime_error("Invalid BMP file");
+        }
+        std::memcpy(format.masks, palette.data(), sizeof(format.masks));
+    }
+    size_t headerBytes = std::max<size_t>(fileInfoHeader.biSize, sizeof(fileInfoHeader)) - sizeof(fileInfoHeader);
+    if (format.bitCount <= 8 && palette.size() > headerBytes) {
+        format.colors.assign(palette.begin() + headerBytes, palette.end());
+    }
+
+    bool runLength = format.compression == compressionRle8 || format.compression == compressionRle4;
+    size_t sourceStride = rowStride();
+    size_t width = fileInfoHeader.biWidth;
+    size_t height = std::abs(fileInfoHeader.biHeight);
+    if (!runLength) {
+        height = std::min(height, size / sourceStride);
+    }
+
+    // from here on the image is an uncompressed 24-bit one with only the info header
+    palette.resize(std::min(palette.size(), headerBytes));
+    fileInfoHeader.biBitCount = 24;
+    fileInfoHeader.biCompression = compressionRgb;
+    fileInfoHeader.biColorsUsed = 0;
+    fileInfoHeader.biColorsImportant = 0;
+    fileHeader.bfOffBits = sizeof(fileHeader) + sizeof(fileInfoHeader) + palette.size();
+
+    std::vector<uint8_t> pixels;
+    MutableImageView decoded = resizePixels(width, height, pixels);
+    if (runLength) {
+        decodeRleToBgr24(format.compression, format.colors, data, size, decoded.data, decoded.stride, width, height);
+    } else {
+        decodeToBgr24(format, data, sourceStride, decoded.data, decoded.stride, width, height);
+    }
+    adoptData(std::move(pixels));
+}
+
+BmpInfo BMP::probe(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::in);
+
     if (!file.is_open()) {
-        std::cerr << "Error opening file: " << filename << std::endl;
+        throw std::runtime_error("Error opening file");
+    }
+
+    bmpHeader header{};
+    bmpInfoHeader infoHeader{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    file.read(reinterpret_cast<char *>(&infoHeader), sizeof(infoHeader));
+
+    if (!file || header.bfType != 0x4D42 || header.bfOffBits < sizeof(header) + sizeof(infoHeader) ||
+        !validDimensions(infoHeader.biWidth, infoHeader.biHeight, infoHeader.biBitCount)) {
+        throw std::runtime_error("Invalid BMP file");
+    }
+
+    BmpInfo info;
+    info.width = infoHeader.biWidth;
+    info.height = infoHeader.biHeight;
+    info.bitCount = infoHeader.biBitCount;
+    info.compression = infoHeader.biCompression;
+    info.dataOffset = header.bfOffBits;
+    info.fileSize = header.bfSize;
+    info.imageSize = infoHeader.biSizeImage;
+    return info;
+}
+
+size_t BMP::imageSize() const {
+    if (fileInfoHeader.biSizeImage != 0) {
+        return fileInfoHeader.biSizeImage;
+    }
+    // biSizeImage may be zero for uncompressed images, rows are padded to 4 bytes
+    return rowStride() * std::abs(fileInfoHeader.biHeight);
+}
+
+size_t BMP::rowStride() const {
+    return (static_cast<size_t>(fileInfoHeader.biWidth) * fileInfoHeader.biBitCount + 31) / 32 * 4;
+}
+
+void BMP::detach() {
+    if (!mapping) {
         return;
     }
+    imageData.assign(mappedData, mappedData + mappedSize);
+    mapping.reset();
+    mappedData = nullptr;
+    mappedSize = 0;
+}
 
-    file.write(reinterpret_cast<char *>(&fileHeader), sizeof(fileHeader));
-    file.write(reinterpret_cast<char *>(&fileInfoHeader), sizeof(fileInfoHeader));
+void BMP::adoptData(std::vector<uint8_t> &&data) {
+    imageData = std::move(data);
+    mapping.reset();
+    mappedData = nullptr;
+    mappedSize = 0;
+}
 
-    file.write(reinterpret_cast<char *>(palette.data()), palette.size());
+uint8_t *BMP::mutableData() {
+    detach();
+    return imageData.data();
+}
 
-    file.write(reinterpret_cast<char *>(const_cast<std::vector<uint8_t> &>(imageData).data()), imageData.size());
+std::vector<uint8_t> BMP::headerBytes() const {
+    std::vector<uint8_t> header(sizeof(fileHeader) + sizeof(fileInfoHeader) + palette.size());
+    std::memcpy(header.data(), &fileHeader, sizeof(fileHeader));
+    std::memcpy(header.data() + sizeof(fileHeader), &fileInfoHeader, sizeof(fileInfoHeader));
+    std::copy(palette.begin(), palette.end(), header.begin() + sizeof(fileHeader) + sizeof(fileInfoHeader));
+    return header;
+}
 
-    file.close();
+void BMP::saveFile(const std::string &filename) {
+    auto header = headerBytes();
+    if (!writeGathered(filename + ".bmp", {{header.data(), header.size()}, {pixelData(), pixelDataSize()}})) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+    }
 }
 
 void BMP::saveFile(const std::string &filename, std::vector<uint8_t> &data) {
+    auto header = headerBytes();
+    if (!writeGathered(filename + ".bmp", {{header.data(), header.size()}, {data.data(), data.size()}})) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+    }
+}
+
+void BMP::saveFile(const std::string &filename, AsyncWriter &writer) {
+    writer.submit(filename + ".bmp", headerBytes(), getData());
+}
+
+void BMP::saveFile(const std::string &filename, const std::vector<uint8_t> &data, AsyncWriter &writer) {
+    writer.submit(filename + ".bmp", headerBytes(), data);
+}
+
+void createNewDir(const std::string &dir) {
+    if (!std::filesystem::is_directory(std::filesystem::path(std::filesystem::current_path() / dir))) {
+        std::filesystem::create_directory(dir);
+    }
+}
+
+std::vector<uint8_t> BMP::getComponent(int componentIdx) {
+    ImageView source = view();
+    std::vector<uint8_t> data(pixelDataSize(), 0x00);
+    MutableImageView result(data.data(), source.width, source.height, source.stride);
+    for (size_t y = 0; y < source.height; ++y) {
+        const uint8_t *in = source.row(y);
+        uint8_t *out = result.row(y);
+        for (size_t x = 0; x < source.width; ++x) {
+            out[x * 3 + componentIdx] = in[x * 3 + componentIdx];
+        }
+    }
+    return data;
+}
+
+std::vector<uint8_t> BMP::getRComponent() {
+    return getComponent(getIndexComponent('r'));
+}
+
+std::vector<uint8_t> BMP::getGComponent() {
+    return getComponent(getIndexComponent('g'));
+}
+
+std::vector<uint8_t> BMP::getBComponent() {
+    return getComponent(getIndexComponent('b'));
+}
+
+void BMP::saveFileComponent(const std::string &filename, char component, Encoding encoding) {
+    int componentIdx = getIndexComponent(component);
+    if (encoding == Encoding::Rle8) {
+        std::vector<uint8_t> colors(256 * 4, 0x00);
+        for (int v = 0; v < 256; ++v) {
+            colors[v * 4 + componentIdx] = static_cast<uint8_t>(v);
+        }
+        saveIndexed(filename, view().channel(componentIdx), colors, encoding, nullptr);
+        return;
+    }
+
     std::ofstream file(filename + ".bmp", std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error opening file: " << filename << std::endl;
@@ -59,58 +275,185 @@ void BMP::saveFile(const std::string &filename, std::vector<uint8_t> &data) {
 
     file.write(reinterpret_cast<char *>(&fileHeader), sizeof(fileHeader));
     file.write(reinterpret_cast<char *>(&fileInfoHeader), sizeof(fileInfoHeader));
-
     file.write(reinterpret_cast<char *>(palette.data()), palette.size());
 
-    file.write(reinterpret_cast<char *>(const_cast<std::vector<uint8_t> &>(data).data()), data.size());
-
-    file.close();
+    maskComponent(componentIdx, [&](const uint8_t *data, size_t size) {
+        file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    });
 }
 
-void createNewDir(std::string &dir) {
-    if (!std::filesystem::is_directory(std::filesystem::path(std::filesystem::current_path() / dir))) {
-        std::filesystem::create_directory(dir);
+void BMP::maskComponent(int componentIdx, const std::function<void(const uint8_t *, size_t)> &write) {
+    // mask the source in chunks of whole rows, only the chunk buffer is allocated
+    const size_t chunkSize = 65536;
+    ImageView source = view();
+    size_t chunkRows = std::max<size_t>(1, chunkSize / source.stride);
+    std::vector<uint8_t> chunk(std::min(chunkRows, source.height) * source.stride);
+
+    for (size_t first = 0; first < source.height; first += chunkRows) {
+        size_t rows = std::min(chunkRows, source.height - first);
+        std::fill(chunk.begin(), chunk.end(), 0x00);
+        MutableImageView masked(chunk.data(), source.width, rows, source.stride);
+        for (size_t y = 0; y < rows; ++y) {
+            const uint8_t *in = source.row(first + y);
+            uint8_t *out = masked.row(y);
+            for (size_t x = 0; x < source.width; ++x) {
+                out[x * 3 + componentIdx] = in[x * 3 + componentIdx];
+            }
+        }
+        write(chunk.data(), rows * source.stride);
+    }
+
+    // bytes after the last complete row are kept zeroed
+    size_t tail = pixelDataSize() - source.height * source.stride;
+    if (tail > 0) {
+        std::vector<uint8_t> zeros(tail, 0);
+        write(zeros.data(), tail);
     }
 }
 
-std::vector<uint8_t> BMP::getRComponent() {
-    std::vector<uint8_t> RData{imageData};
-    for (int i = 0; i < RData.size(); i += 3) {
-        RData[i] = 0x00;
-        RData[i + 1] = 0x00;
+void BMP::saveFileByComponents(const std::string &filename, Encoding encoding, AsyncWriter *writer) {
+    std::string dir = "component";
+    createNewDir(dir);
+
+    for (char component: {'r', 'g', 'b'}) {
+        std::string path = dir + "/" + static_cast<char>(std::toupper(component)) + filename;
+        if (writer != nullptr && encoding == Encoding::Raw) {
+            // each masked chunk is copied out for the writer, which appends them in order
+            writer->submit(path + ".bmp", headerBytes(), {});
+            maskComponent(getIndexComponent(component), [&](const uint8_t *data, size_t size) {
+                writer->append(path + ".bmp", std::vector<uint8_t>(data, data + size));
+            });
+        } else {
+            saveFileComponent(path, component, encoding);
+        }
     }
-    return RData;
 }
 
-std::vector<uint8_t> BMP::getGComponent() {
-    std::vector<uint8_t> GData{imageData};
-    for (int i = 0; i < GData.size(); i += 3) {
-        GData[i] = 0x00;
-        GData[i + 2] = 0x00;
+void BMP::saveIndexed(const std::string &filename, const ChannelView &indices,
+                      const std::vector<uint8_t> &colors, Encoding encoding, AsyncWriter *writer) {
+    size_t width = indices.width;
+    size_t height = indices.height;
+    bool rle = encoding == Encoding::Rle8;
+    // RLE images are always stored bottom-up, top-down rows are written in reverse
+    bool flip = rle && fileInfoHeader.biHeight < 0;
+
+    // gathers one row of indices, step bytes apart in the view, into row
+    size_t stride = (width + 3) / 4 * 4;
+    std::vector<uint8_t> row(stride, 0x00);
+    auto gather = [&](size_t y) {
+        const uint8_t *in = indices.data + (flip ? height - 1 - y : y) * indices.rowStride;
+        for (size_t x = 0; x < width; ++x) {
+            row[x] = in[x * indices.step];
+        }
+    };
+
+    // RLE data is encoded up front, its size goes into the headers
+    std::vector<uint8_t> encoded;
+    if (rle) {
+        for (size_t y = 0; y < height; ++y) {
+            gather(y);
+            appendRle8Row(row.data(), width, encoded);
+            // end of line, or end of bitmap after the last row
+            encoded.push_back(0);
+            encoded.push_back(y + 1 < height ? 0 : 1);
+        }
+    }
+
+    bmpInfoHeader infoHeader = fileInfoHeader;
+    infoHeader.biSize = sizeof(infoHeader);
+    infoHeader.biWidth = static_cast<int32_t>(width);
+    infoHeader.biHeight = flip ? -fileInfoHeader.biHeight : fileInfoHeader.biHeight;
+    infoHeader.biBitCount = 8;
+    infoHeader.biCompression = rle ? compressionRle8 : compressionRgb;
+    infoHeader.biSizeImage = rle ? encoded.size() : stride * height;
+    infoHeader.biColorsUsed = colors.size() / 4;
+    infoHeader.biColorsImportant = 0;
+
+    bmpHeader header = fileHeader;
+    header.bfOffBits = sizeof(header) + sizeof(infoHeader) + colors.size();
+    header.bfSize = header.bfOffBits + infoHeader.biSizeImage;
+
+    std::vector<uint8_t> headers(header.bfOffBits);
+    std::memcpy(headers.data(), &header, sizeof(header));
+    std::memcpy(headers.data() + sizeof(header), &infoHeader, sizeof(infoHeader));
+    std::copy(colors.begin(), colors.end(), headers.begin() + sizeof(header) + sizeof(infoHeader));
+
+    if (writer != nullptr) {
+        // the writer needs the pixels in a buffer it owns
+        std::vector<uint8_t> pixels = std::move(encoded);
+        if (!rle) {
+            pixels.resize(stride * height);
+            for (size_t y = 0; y < height; ++y) {
+                gather(y);
+                std::memcpy(pixels.data() + y * stride, row.data(), stride);
+            }
+        }
+        writer->submit(filename + ".bmp", std::move(headers), std::move(pixels));
+        return;
+    }
+
+    std::ofstream file(filename + ".bmp", std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        return;
+    }
+    file.write(reinterpret_cast<char *>(headers.data()), headers.size());
+
+    if (rle) {
+        file.write(reinterpret_cast<char *>(encoded.data()), encoded.size());
+        return;
+    }
+    // uncompressed rows are streamed through a chunk of whole rows
+    const size_t chunkSize = 65536;
+    size_t chunkRows = std::max<size_t>(1, chunkSize / stride);
+    std::vector<uint8_t> chunk(std::min(chunkRows, height) * stride);
+    for (size_t first = 0; first < height; first += chunkRows) {
+        size_t rows = std::min(chunkRows, height - first);
+        for (size_t y = 0; y < rows; ++y) {
+            gather(first + y);
+            std::memcpy(chunk.data() + y * stride, row.data(), stride);
+        }
+        file.write(reinterpret_cast<char *>(chunk.data()), rows * stride);
     }
-    return GData;
 }
 
-std::vector<uint8_t> BMP::getBComponent() {
-    std::vector<uint8_t> BData{imageData};
-    for (int i = 0; i < BData.size(); i += 3) {
-        BData[i + 1] = 0x00;
-        BData[i + 2] = 0x00;
+void BMP::saveFileGray(const std::string &filename, const ChannelView &channel, Encoding encoding,
+                       AsyncWriter *writer) {
+    std::vector<uint8_t> colors(256 * 4, 0x00);
+    for (int v = 0; v < 256; ++v) {
+        std::fill_n(colors.begin() + v * 4, 3, static_cast<uint8_t>(v));
     }
-    return BData;
+    saveIndexed(filename, channel, colors, encoding, writer);
 }
 
-void BMP::saveFileByComponents(const std::string &filename) {
-    std::string dir = "component";
-    createNewDir(dir);
+ImageView BMP::view() const {
+    return view(pixelData(), pixelDataSize());
+}
 
-    auto R = getRComponent();
-    auto G = getGComponent();
-    auto B = getBComponent();
+ImageView BMP::view(const std::vector<uint8_t> &data) const {
+    return view(data.data(), data.size());
+}
 
-    saveFile(dir + "/R" + filename, R);
-    saveFile(dir + "/G" + filename, G);
-    saveFile(dir + "/B" + filename, B);
+ImageView BMP::view(const uint8_t *data, size_t size) const {
+    size_t height = std::min<size_t>(std::abs(fileInfoHeader.biHeight), size / rowStride());
+    return {data, static_cast<size_t>(fileInfoHeader.biWidth), height, rowStride()};
+}
+
+ChannelView BMP::channel(char component) const {
+    return view().channel(getIndexComponent(component));
+}
+
+ChannelView BMP::channel(char component, const std::vector<uint8_t> &data) const {
+    return view(data).channel(getIndexComponent(component));
+}
+
+MutableImageView BMP::resizePixels(size_t width, size_t height, std::vector<uint8_t> &data) {
+    fileInfoHeader.biWidth = static_cast<int32_t>(width);
+    fileInfoHeader.biHeight = fileInfoHeader.biHeight < 0 ? -static_cast<int32_t>(height) : static_cast<int32_t>(height);
+    data.assign(rowStride() * height, 0x00);
+    fileInfoHeader.biSizeImage = data.size();
+    fileHeader.bfSize = data.size() + fileHeader.bfOffBits;
+    return {data.data(), width, height, rowStride()};
 }
 
 
@@ -143,252 +486,249 @@ int getIndexComponent(char componentChar) {
 
 
 double BMP::countMathExp(char component, const std::vector<uint8_t> &data) {
-    double sum = 0;
-
-    int componentIdx = getIndexComponent(component);
-
-    for (int i = 0; i < fileInfoHeader.biSizeImage; i += 3) {
-        sum += data[i + componentIdx];
-    }
-
-    return sum / (fileInfoHeader.biHeight * fileInfoHeader.biWidth);
+    return countStats(data).meanOf(component);
 }
 
 double BMP::countStandardDeviation(char component, const std::vector<uint8_t> &data) {
-    double sum = 0;
+    return countStats(data).standardDeviationOf(component);
+}
 
-    double mean = countMathExp(component, data);
-    int componentIdx = getIndexComponent(component);
+double BMP::countEntropy(char component, const std::vector<uint8_t> &data) {
+    return channel(component, data).histogram().entropy();
+}
 
-    for (int i = 0; i < fileInfoHeader.biSizeImage; i += 3) {
-        double tmp = data[i + componentIdx] - mean;
-        sum += tmp * tmp;
-    }
-    sum = sum / ((fileInfoHeader.biWidth * fileInfoHeader.biHeight) - 1);
-    return sqrt(sum);
+ChannelHistograms BMP::countHistograms(const std::vector<uint8_t> &data) {
+    ImageView image = view(data);
+    return reduceRows<ChannelHistograms>(
+            image.height, image.stride,
+            [&](size_t first, size_t end) {
+                ChannelHistograms histograms;
+                histograms.add(image.rows(first, end));
+                return histograms;
+            },
+            [](ChannelHistograms &total, const ChannelHistograms &band) { total.merge(band); });
 }
 
 double BMP::countCorrelCoef(char component1, char component2, const std::vector<uint8_t> &data) {
-    int componentIdx1 = getIndexComponent(component1);
-    int componentIdx2 = getIndexComponent(component2);
-
-    double mean1 = countMathExp(component1, data);
-    double mean2 = countMathExp(component2, data);
-
-    double deviation1 = countStandardDeviation(component1, data);
-    double deviation2 = countStandardDeviation(component2, data);
-
-    double sumCorrel = 0;
-    double sumPixComDiv1 = 0;
-    double sumPixComDiv2 = 0;
-
-
-    for (int i = 0; i < fileInfoHeader.biSizeImage; i += 3) {
-        double pixelComponent1 = data[i + componentIdx1];
-        double pixelComponent2 = data[i + componentIdx2];
+    return countStats(data).correlationOf(component1, component2);
+}
 
-        double deviationPixelComponent1 = pixelComponent1 - mean1;
-        double deviationPixelComponent2 = pixelComponent2 - mean2;
+ChannelStats BMP::countStats(const std::vector<uint8_t> &data) {
+    ImageView image = view(data);
+    return reduceRows<StatsAccumulator>(
+            image.height, image.stride,
+            [&](size_t first, size_t end) {
+                StatsAccumulator stats;
+                stats.update(image.rows(first, end));
+                return stats;
+            },
+            [](StatsAccumulator &total, const StatsAccumulator &band) { total.merge(band); }).finalize();
+}
 
-        sumCorrel += deviationPixelComponent1 * deviationPixelComponent2;
-        sumPixComDiv1 = deviationPixelComponent1 * deviationPixelComponent2;
-        sumPixComDiv2 = deviationPixelComponent1 * deviationPixelComponent2;
+namespace {
+    // Calls function(in, out, pixelCount) for rows [first, end) of two views of the
+    // same size and stride, padding-free rows in a single call.
+    template<typename Function>
+    void forEachRow(const ImageView &source, const MutableImageView &destination,
+                    size_t first, size_t end, Function function) {
+        if (source.contiguous() && source.stride == destination.stride) {
+            function(source.row(first), destination.row(first), source.width * (end - first));
+            return;
+        }
+        for (size_t y = first; y < end; ++y) {
+            function(source.row(y), destination.row(y), source.width);
+        }
     }
-
-    return (sumCorrel / (fileInfoHeader.biHeight * fileInfoHeader.biWidth)) / (deviation1 * deviation2);
 }
 
-std::vector<uint8_t> BMP::convertRGBToYCbCr() {
-    std::vector<uint8_t> result;
-    std::vector<uint8_t> resultY;
-    std::vector<uint8_t> resultCb;
-    std::vector<uint8_t> resultCr;
-
-    resultY.reserve(imageData.size());
-    resultCb.reserve(imageData.size());
-    resultCr.reserve(imageData.size());
+std::vector<uint8_t> BMP::convertRGBToYCbCr(ImageSink *sink) {
+    ImageView source = view();
+    std::vector<uint8_t> result(pixelDataSize());
+    MutableImageView converted(result.data(), source.width, source.height, source.stride);
+    parallelRows(source.height, source.stride, [&](size_t first, size_t end) {
+        forEachRow(source, converted, first, end, convertRGBToYCbCrPixels);
+    });
 
-    for (int i = 0; i < imageData.size(); i += 3) {
-
-        uint8_t r = imageData[i];
-        uint8_t g = imageData[i + 1];
-        uint8_t b = imageData[i + 2];
+    if (sink == nullptr) {
+        return result;
+    }
 
+    sink->writeGray(*this, "Y", converted.channel(0));
+    sink->writeGray(*this, "Cb", converted.channel(1));
+    sink->writeGray(*this, "Cr", converted.channel(2));
+    sink->write(*this, "YCbCr", result);
+    return result;
+}
 
-        auto y = static_cast<uint8_t>(0.299 * r + 0.587 * g + 0.114 * b);
-        auto cb = static_cast<uint8_t>(0.5643 * (b - y) + 128);
-        auto cr = static_cast<uint8_t>(0.7132 * (r - y) + 128);
+std::vector<uint8_t> BMP::convertYbCrToRGB(const std::vector<uint8_t> &data, ImageSink *sink) {
+    ImageView source = view(data);
+    std::vector<uint8_t> result(data.size());
+    MutableImageView converted(result.data(), source.width, source.height, source.stride);
+    parallelRows(source.height, source.stride, [&](size_t first, size_t end) {
+        forEachRow(source, converted, first, end, convertYCbCrToRGBPixels);
+    });
 
-        resultY.emplace_back(y);
-        resultY.emplace_back(y);
-        resultY.emplace_back(y);
-        result.emplace_back(y);
-        resultCb.emplace_back(cb);
-        resultCb.emplace_back(cb);
-        resultCb.emplace_back(cb);
-        result.emplace_back(cb);
-        resultCr.emplace_back(cr);
-        resultCr.emplace_back(cr);
-        resultCr.emplace_back(cr);
-        result.emplace_back(cr);
+    if (sink != nullptr) {
+        sink->write(*this, "reconvertedRGB", result);
     }
-    std::string dir = "YCbCr";
-    createNewDir(dir);
-    saveFile(dir + "/Y", resultY);
-    saveFile(dir + "/Cb", resultCb);
-    saveFile(dir + "/Cr", resultCr);
-    saveFile(dir + "/YCbCr", result);
     return result;
 }
 
-std::vector<uint8_t> BMP::convertYbCrToRGB(const std::vector<uint8_t> &data) {
-    std::vector<uint8_t> result;
+SubsampledImage BMP::subsampleChroma(const std::vector<uint8_t> &yCbCr, ChromaSubsampling factors) const {
+    return SubsampledImage::subsample(view(yCbCr), factors);
+}
 
-    result.reserve(data.size());
+std::vector<uint8_t> BMP::upsampleChroma(const SubsampledImage &image) const {
+    std::vector<uint8_t> yCbCr(rowStride() * image.height(), 0x00);
+    image.upsample(MutableImageView(yCbCr.data(), image.width(), image.height(), rowStride()));
+    return yCbCr;
+}
 
+ErrorStats BMP::countErrors(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2) const {
+    ImageView image1 = view(data1);
+    ImageView image2 = view(data2);
+    size_t height = std::min(image1.height, image2.height);
+    return ::countErrors(image1.rows(0, height), image2.rows(0, height));
+}
 
-    for (int i = 0; i < data.size(); i += 3) {
-        uint8_t Y = data[i];
-        uint8_t Cb = data[i + 1];
-        uint8_t Cr = data[i + 2];
+double BMP::countPSNR(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2, char component) const {
+    return countErrors(data1, data2).psnrOf(component);
+}
 
-        auto r = saturation(Y + 1.402 * (Cr - 128), 0, 255);
-        auto g = saturation(Y - 0.714 * (Cr - 128) - 0.334 * (Cb - 128), 0, 255);
-        auto b = saturation(Y + 1.772 * (Cb - 128), 0, 255);
+double BMP::countSSIM(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2, char component) const {
+    ImageView image1 = view(data1);
+    ImageView image2 = view(data2);
+    size_t height = std::min(image1.height, image2.height);
+    int componentIdx = getIndexComponent(component);
+    return ::countSSIM(image1.rows(0, height).channel(componentIdx), image2.rows(0, height).channel(componentIdx));
+}
 
-        result.emplace_back(r);
-        result.emplace_back(g);
-        result.emplace_back(b);
-    }
-    std::string dir = "RGB";
-    createNewDir(dir);
+double BMP::countMSSSIM(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2, char component) const {
+    ImageView image1 = view(data1);
+    ImageView image2 = view(data2);
+    size_t height = std::min(image1.height, image2.height);
+    int componentIdx = getIndexComponent(component);
+    return ::countMSSSIM(image1.rows(0, height).channel(componentIdx), image2.rows(0, height).channel(componentIdx));
+}
 
-    saveFile(dir + "/reconvertedRGB", result);
-    return result;
+PlanarImage BMP::getPlanar() const {
+    ImageView image = view();
+    return PlanarImage::deinterleave(image.data, static_cast<int>(image.width), static_cast<int>(image.height),
+                                     image.stride);
 }
 
-double BMP::countPSNR(std::vector<uint8_t> data1, std::vector<uint8_t> data2, char component) {
-    auto componentIdx = getIndexComponent(component);
-    double sum{};
-    for (int i = 0; i < fileInfoHeader.biHeight; ++i) {
-        for (int j = 0; j < fileInfoHeader.biWidth; ++j) {
-            size_t pixelOffset = (i * fileInfoHeader.biWidth + j) * 3;
-            sum += pow((data1[pixelOffset + componentIdx] - data2[pixelOffset + componentIdx]), 2);
-        }
-    }
-    double result = 10 * std::log10(fileInfoHeader.biWidth * fileInfoHeader.biHeight * \
-        std::pow(std::pow(2, 8) - 1, 2) / sum);
-    return result;
+void BMP::assignPlanar(const PlanarImage &image) {
+    std::vector<uint8_t> data;
+    MutableImageView result = resizePixels(image.width(), image.height(), data);
+    image.interleave(result.data, result.stride);
+    adoptData(std::move(data));
 }
 
 void BMP::decimateImageEven(int num) {
-    int originalWidth = fileInfoHeader.biWidth;
-    int originalHeight = fileInfoHeader.biHeight;
-
-    int newWidth = originalWidth / num;
-    int newHeight = originalHeight / num;
-
+    ImageView source = view();
     std::vector<uint8_t> decimatedImageData;
-
-    for (int y = 0; y < originalHeight; y += num) {
-        for (int x = 0; x < originalWidth; x += num) {
-            int index = (y * originalWidth + x) * 3;
-
-            decimatedImageData.push_back(imageData[index]);
-            decimatedImageData.push_back(imageData[index + 1]);
-            decimatedImageData.push_back(imageData[index + 2]);
+    MutableImageView decimated = resizePixels(source.width / num, source.height / num, decimatedImageData);
+
+    parallelRows(decimated.height, decimated.stride, [&](size_t first, size_t end) {
+        for (size_t y = first; y < end; ++y) {
+            for (size_t x = 0; x < decimated.width; ++x) {
+                const uint8_t *in = source.pixel(x * num, y * num);
+                uint8_t *out = decimated.pixel(x, y);
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+            }
         }
-    }
+    });
 
-    fileInfoHeader.biWidth = newWidth;
-    fileInfoHeader.biHeight = newHeight;
-    fileInfoHeader.biSizeImage = decimatedImageData.size();
-    fileHeader.bfSize = decimatedImageData.size() + fileHeader.bfOffBits;
-
-    imageData = decimatedImageData;
+    adoptData(std::move(decimatedImageData));
     saveFile("RGB/decimationEven");
 }
 
 void BMP::decimateImageAvg() {
-    int originalWidth = fileInfoHeader.biWidth;
-    int originalHeight = fileInfoHeader.biHeight;
-
-    int newWidth = originalWidth / 2;
-    int newHeight = originalHeight / 2;
-
+    ImageView source = view();
     std::vector<uint8_t> decimatedImageData;
-
-    for (int y = 0; y < newHeight; ++y) {
-        for (int x = 0; x < newWidth; ++x) {
-            int index1 = ((2 * y) * originalWidth + (2 * x)) * 3; // left-up pixel
-            int index2 = index1 + 3; // right-up pixel
-            int index3 = index1 + originalWidth * 3; // left-bottom pixel
-            int index4 = index3 + 3; // left bottom pixel
-
-
-            uint8_t averageR = (imageData[index1] + imageData[index2] +
-                                imageData[index3] + imageData[index4]) / 4;
-            uint8_t averageG = (imageData[index1 + 1] + imageData[index2 + 1] +
-                                imageData[index3 + 1] + imageData[index4 + 1]) / 4;
-            uint8_t averageB = (imageData[index1 + 2] + imageData[index2 + 2] +
-                                imageData[index3 + 2] + imageData[index4 + 2]) / 4;
-
-            decimatedImageData.push_back(averageR);
-            decimatedImageData.push_back(averageG);
-            decimatedImageData.push_back(averageB);
+    MutableImageView decimated = resizePixels(source.width / 2, source.height / 2, decimatedImageData);
+
+    parallelRows(decimated.height, decimated.stride, [&](size_t first, size_t end) {
+        for (size_t y = first; y < end; ++y) {
+            const uint8_t *top = source.row(2 * y);
+            const uint8_t *bottom = source.row(2 * y + 1);
+            uint8_t *out = decimated.row(y);
+            for (size_t x = 0; x < decimated.width; ++x) {
+                for (size_t c = 0; c < 3; ++c) {
+                    size_t left = 6 * x + c;
+                    out[3 * x + c] = (top[left] + top[left + 3] + bottom[left] + bottom[left + 3]) / 4;
+                }
+            }
         }
-    }
-
-    fileInfoHeader.biWidth = newWidth;
-    fileInfoHeader.biHeight = newHeight;
-    fileInfoHeader.biSizeImage = decimatedImageData.size();
-    fileHeader.bfSize = decimatedImageData.size() + fileHeader.bfOffBits;
+    });
 
-    imageData = decimatedImageData;
+    adoptData(std::move(decimatedImageData));
     saveFile("RGB/decimationAvg");
 }
 
-    void BMP::restoreImage(int num) {
-        int originalWidth = fileInfoHeader.biWidth;
-        int originalHeight = fileInfoHeader.biHeight;
-
-        int newWidth = originalWidth * num;
-        int newHeight = originalHeight * num;
-
-        std::vector<uint8_t> restoredImageData(newWidth * newHeight * 3);
+void BMP::decimateImageBox(int horizontal, int vertical) {
+    if (horizontal <= 0 || vertical <= 0) {
+        throw std::runtime_error("Invalid decimation factors");
+    }
+    ImageView source = view();
+    std::vector<uint8_t> decimatedImageData;
+    MutableImageView decimated = resizePixels(source.width / horizontal, source.height / vertical, decimatedImageData);
+    decimateBox(source, decimated, horizontal, vertical);
 
-        auto decimatedImageData = imageData;
+    adoptData(std::move(decimatedImageData));
+    saveFile("RGB/decimationBox");
+}
 
-        for (int y = 0; y < newHeight; ++y) {
-            for (int x = 0; x < newWidth; ++x) {
-                int restoredIndex = (y * newWidth + x) * 3;
-                if ((x % 2 == 0 && y % 2 == 0) || (x % 2 != 0 && y % 2 != 0)) {
-                    int originalX = x / num;
-                    int originalY = y / num;
-                    int originalIndex = (originalY * originalWidth + originalX) * 3;
-                    restoredImageData[restoredIndex] = decimatedImageData[originalIndex];
-                    restoredImageData[restoredIndex + 1] = decimatedImageData[originalIndex + 1];
-                    restoredImageData[restoredIndex + 2] = decimatedImageData[originalIndex + 2];
-                } else {
+void BMP::restoreImage(int num) {
+    ImageView source = view();
+    std::vector<uint8_t> restoredImageData;
+    MutableImageView restored = resizePixels(source.width * num, source.height * num, restoredImageData);
+
+    // Pixels where x and y have the same parity come from the decimated image, the
+    // others repeat their left neighbour (or the pixel above in the first column).
+    // Resolving that neighbour up front makes every row independent.
+    parallelRows(restored.height, restored.stride, [&](size_t first, size_t end) {
+        for (size_t y = first; y < end; ++y) {
+            for (size_t x = 0; x < restored.width; ++x) {
+                size_t sourceX = x;
+                size_t sourceY = y;
+                if (x % 2 != y % 2) {
                     if (x > 0) {
-                        int neighborIndex = ((y * newWidth) + (x - 1)) * 3;
-                        restoredImageData[restoredIndex] = restoredImageData[neighborIndex];
-                        restoredImageData[restoredIndex + 1] = restoredImageData[neighborIndex + 1];
-                        restoredImageData[restoredIndex + 2] = restoredImageData[neighborIndex + 2];
+                        sourceX = x - 1;
                     } else if (y > 0) {
-                        int neighborIndex = (((y - 1) * newWidth) + x) * 3;
-                        restoredImageData[restoredIndex] = restoredImageData[neighborIndex];
-                        restoredImageData[restoredIndex + 1] = restoredImageData[neighborIndex + 1];
-                        restoredImageData[restoredIndex + 2] = restoredImageData[neighborIndex + 2];
+                        sourceY = y - 1;
+                    } else {
+                        continue;
                     }
                 }
+                const uint8_t *in = source.pixel(sourceX / num, sourceY / num);
+                uint8_t *out = restored.pixel(x, y);
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
             }
         }
-        fileInfoHeader.biWidth = newWidth;
-        fileInfoHeader.biHeight = newHeight;
-        fileInfoHeader.biSizeImage = restoredImageData.size();
-        fileHeader.bfSize = restoredImageData.size() + fileHeader.bfOffBits;
+    });
+
+    adoptData(std::move(restoredImageData));
+    saveFile("RGB/restored");
+}
 
-        imageData = restoredImageData;
-        saveFile("RGB/restored");
+void BMP::restoreImage(int num, ResampleFilter filter) {
+    if (num <= 0) {
+        throw std::runtime_error("Restoration factor must be positive");
     }
+    ImageView source = view();
+    resizeImage(source.width * num, source.height * num, filter);
+    saveFile(std::string("RGB/restored") + resampleFilterName(filter));
+}
+
+void BMP::resizeImage(size_t width, size_t height, ResampleFilter filter) {
+    ImageView source = view();
+    std::vector<uint8_t> resizedImageData;
+    MutableImageView resized = resizePixels(width, height, resizedImageData);
+    resample(source, resized, filter);
+    adoptData(std::move(resizedImageData));
+}
@@ -5,9 +5,49 @@
 #ifndef BMPANALYZER_BMP_H
 #define BMPANALYZER_BMP_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
+#include "channelview.h"
+#include "chroma.h"
+#include "histogram.h"
+#include "imageview.h"
+#include "planarimage.h"
+#include "quality.h"
+#include "resample.h"
+#include "stats.h"
+
+class AsyncWriter;
+
+class ImageSink;
+
+class MappedFile;
+
+enum class LoadMode {
+    Stream, // read headers, palette and pixels into owned buffers
+    Map     // borrow the pixels from a read-only mapping of the file (24-bit only,
+            // other pixel formats are decoded into owned buffers either way)
+};
+
+// Header fields of a BMP file, read without touching the pixels (see BMP::probe).
+struct BmpInfo {
+    int32_t width = 0;
+    int32_t height = 0; // negative for top-down images
+    uint16_t bitCount = 0;
+    uint32_t compression = 0;
+    uint32_t dataOffset = 0;
+    uint32_t fileSize = 0;
+    uint32_t imageSize = 0;
+};
+
+enum class Encoding {
+    Raw, // uncompressed pixels
+    Rle8 // 8-bit BI_RLE8 with a colour table, for images of at most 256 colours
+};
 
 class BMP {
 #pragma pack(push)
@@ -36,27 +76,74 @@ class BMP {
     std::vector<uint8_t> imageData;
     std::vector<uint8_t> palette;
 
+    // Set while the pixels are borrowed from a file mapping instead of imageData.
+    std::shared_ptr<const MappedFile> mapping;
+    const uint8_t *mappedData = nullptr;
+    size_t mappedSize = 0;
+
 
 public:
     BMP() = default;
 
-    BMP(const std::string &filename);
+    BMP(const std::string &filename, LoadMode mode = LoadMode::Stream);
+
+    // Reads only the file and info headers; throws like the constructor on invalid files.
+    static BmpInfo probe(const std::string &filename);
 
     void saveFile(const std::string &filename);
 
     void saveFile(const std::string &filename, std::vector<uint8_t> &data);
 
+    // Queue the file on writer and return at once; the pixels are copied first.
+    void saveFile(const std::string &filename, AsyncWriter &writer);
+
+    void saveFile(const std::string &filename, const std::vector<uint8_t> &data, AsyncWriter &writer);
+
     std::vector<uint8_t> getRComponent();
 
     std::vector<uint8_t> getGComponent();
 
     std::vector<uint8_t> getBComponent();
 
-    std::vector<uint8_t> convertRGBToYCbCr();
+    // Returns the interleaved Y, Cb, Cr image; it goes to sink as YCbCr, and the
+    // channels as 8-bit grayscale Y, Cb and Cr images, if a sink is given.
+    std::vector<uint8_t> convertRGBToYCbCr(ImageSink *sink = nullptr);
+
+    // Returns the RGB image; it goes to sink as reconvertedRGB if given.
+    std::vector<uint8_t> convertYbCrToRGB(const std::vector<uint8_t> &data, ImageSink *sink = nullptr);
 
-    std::vector<uint8_t> convertYbCrToRGB(const std::vector<uint8_t> &data);
+    // Keeps Y of a YCbCr buffer at full resolution and decimates Cb and Cr by factors.
+    SubsampledImage subsampleChroma(const std::vector<uint8_t> &yCbCr, ChromaSubsampling factors) const;
 
-    void saveFileByComponents(const std::string &filename);
+    // Full-resolution YCbCr buffer, laid out like the pixels, from a subsampled image.
+    std::vector<uint8_t> upsampleChroma(const SubsampledImage &image) const;
+
+    // Without a writer every component streams through saveFileComponent. With
+    // one, uncompressed components are queued as the header and then masked
+    // 64 KB chunks, so the writer never holds more than its byte budget.
+    void saveFileByComponents(const std::string &filename, Encoding encoding = Encoding::Raw,
+                              AsyncWriter *writer = nullptr);
+
+    // Writes the image with every channel but component zeroed, streaming from the
+    // pixels. With Encoding::Rle8 the channel values become 8-bit RLE indices into
+    // a table of the 256 masked colours, which loads back to the same pixels.
+    void saveFileComponent(const std::string &filename, char component, Encoding encoding = Encoding::Raw);
+
+    // Writes one channel as an 8-bit grayscale image with a 256-entry palette,
+    // a third of the size of the 24-bit image repeating every value three times.
+    // Rows stream to the file in chunks; a writer instead gets an owned copy of the plane.
+    void saveFileGray(const std::string &filename, const ChannelView &channel, Encoding encoding = Encoding::Raw,
+                      AsyncWriter *writer = nullptr);
+
+    // Padding-aware view of the pixels, or of a buffer laid out like them, in file row order.
+    ImageView view() const;
+
+    ImageView view(const std::vector<uint8_t> &data) const;
+
+    // Zero-copy view of one channel of the pixels, or of a buffer laid out like them.
+    ChannelView channel(char component) const;
+
+    ChannelView channel(char component, const std::vector<uint8_t> &data) const;
 
     double countMathExp(char component, const std::vector<uint8_t> &data);
 
@@ -64,28 +151,108 @@ public:
 
     double countCorrelCoef(char component1, char component2, const std::vector<uint8_t> &data);
 
-    double countPSNR(std::vector<uint8_t> data1, std::vector<uint8_t> data2, char component);
+    // Per-channel 256-bin histograms of all channels in one pass.
+    ChannelHistograms countHistograms(const std::vector<uint8_t> &data);
+
+    double countEntropy(char component, const std::vector<uint8_t> &data);
+
+    // Mean, deviation, covariance and correlation of all channels in one pass.
+    ChannelStats countStats(const std::vector<uint8_t> &data);
+
+    // MSE and PSNR of every channel in one pass, over the rows both buffers hold.
+    ErrorStats countErrors(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2) const;
+
+    double countPSNR(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2, char component) const;
+
+    // Box-window SSIM and MS-SSIM of one channel, over the rows both buffers hold.
+    double countSSIM(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2, char component) const;
+
+    double countMSSSIM(const std::vector<uint8_t> &data1, const std::vector<uint8_t> &data2, char component) const;
 
     std::vector<uint8_t> getData() {
-        return imageData;
+        return {pixelData(), pixelData() + pixelDataSize()};
+    }
+
+    const uint8_t *pixelData() const {
+        return mapping ? mappedData : imageData.data();
+    }
+
+    size_t pixelDataSize() const {
+        return mapping ? mappedSize : imageData.size();
+    }
+
+    int width() const {
+        return fileInfoHeader.biWidth;
+    }
+
+    int height() const {
+        return std::abs(fileInfoHeader.biHeight);
     }
 
+    bool isMapped() const {
+        return mapping != nullptr;
+    }
+
+    // Copies borrowed pixels into imageData before handing out a writable pointer.
+    uint8_t *mutableData();
+
+    // Pixels split into one plane per channel, rows in file order.
+    PlanarImage getPlanar() const;
+
+    // Replaces the pixels (and the size in the headers) with the interleaved planes.
+    void assignPlanar(const PlanarImage &image);
+
     void decimateImageEven(int num);
 
     void decimateImageAvg();
 
+    // Rounded mean of every horizontal x vertical block (box filter).
+    void decimateImageBox(int horizontal, int vertical);
+
     void restoreImage(int num);
 
+    // Enlarges num times with a resampling filter, saved per filter name.
+    void restoreImage(int num, ResampleFilter filter);
+
+    // Resamples the pixels to width x height, for any ratio either way.
+    void resizeImage(size_t width, size_t height, ResampleFilter filter);
+
 private:
 
-    uint8_t saturation(double x, int x_min, int x_max) {
-        if (x < x_min) {
-            return x_min;
-        } else if (x > x_max) {
-            return x_max;
-        }
-        return static_cast<uint8_t>(x);
-    }
+    size_t imageSize() const;
+
+    // Replaces the stored pixels of a non-24-bit image with their 24-bit decoding
+    // and rewrites the headers to match. Only called once the constructor has
+    // validated the headers, so the source stride is never zero.
+    void decodePixels(const uint8_t *data, size_t size);
+
+    std::vector<uint8_t> getComponent(int componentIdx);
+
+    // Passes the pixel data with every channel but componentIdx zeroed to write in
+    // chunks of whole rows, followed by the zeroed bytes after the last row.
+    void maskComponent(int componentIdx, const std::function<void(const uint8_t *, size_t)> &write);
+
+    size_t rowStride() const;
+
+    ImageView view(const uint8_t *data, size_t size) const;
+
+    // Sets the size in the headers and allocates data for the new pixels.
+    MutableImageView resizePixels(size_t width, size_t height, std::vector<uint8_t> &data);
+
+    // File and info headers followed by the palette bytes, as written before the pixels.
+    std::vector<uint8_t> headerBytes() const;
+
+    // Writes a channel as 8-bit indices (rows in file order) into the given BGRX colour table.
+    void saveIndexed(const std::string &filename, const ChannelView &indices,
+                     const std::vector<uint8_t> &colors, Encoding encoding, AsyncWriter *writer);
+
+    void detach();
+
+    void adoptData(std::vector<uint8_t> &&data);
 };
 
+int getIndexComponent(char componentChar);
+
+void createNewDir(const std::string &dir);
+
 #endif //BMPANALYZER_BMP_H
@@ -0,0 +1,83 @@
+#include <cstring>
+#include <stdexcept>
+#include "channelview.h"
+#include "histogram.h"
+#include "stats.h"
+#include "threadpool.h"
+
+namespace {
+    ChannelView bandOf(const ChannelView &view, size_t first, size_t end) {
+        ChannelView band = view;
+        band.data = view.data + first * view.rowStride;
+        band.height = end - first;
+        return band;
+    }
+}
+
+Histogram ChannelView::histogram() const {
+    return reduceRows<Histogram>(
+            height, width * step,
+            [this](size_t first, size_t end) { return bandOf(*this, first, end).histogramSerial(); },
+            [](Histogram &total, const Histogram &band) { total.merge(band); });
+}
+
+Histogram ChannelView::histogramSerial() const {
+    // four sub-histograms, as in ChannelHistograms::add, merged at the end
+    uint32_t sub[4][256];
+    std::memset(sub, 0, sizeof(sub));
+    uint64_t pending = 0;
+    Histogram result;
+
+    auto flush = [&] {
+        for (int v = 0; v < 256; ++v) {
+            result.bins[v] += uint64_t{sub[0][v]} + sub[1][v] + sub[2][v] + sub[3][v];
+        }
+        std::memset(sub, 0, sizeof(sub));
+        pending = 0;
+    };
+
+    for (size_t y = 0; y < height; ++y) {
+        if (pending + width > UINT32_MAX) {
+            flush();
+        }
+        const uint8_t *row = data + y * rowStride;
+        size_t x = 0;
+        for (; x + 4 <= width; x += 4) {
+            ++sub[0][row[x * step]];
+            ++sub[1][row[(x + 1) * step]];
+            ++sub[2][row[(x + 2) * step]];
+            ++sub[3][row[(x + 3) * step]];
+        }
+        for (; x < width; ++x) {
+            ++sub[0][row[x * step]];
+        }
+        pending += width;
+    }
+    flush();
+    return result;
+}
+
+double ChannelView::mean() const {
+    return histogram().mean();
+}
+
+double ChannelView::standardDeviation() const {
+    return histogram().standardDeviation();
+}
+
+double correlation(const ChannelView &view1, const ChannelView &view2) {
+    if (view1.width != view2.width || view1.height != view2.height) {
+        throw std::runtime_error("Channel views differ in size");
+    }
+
+    // the second view fills the unused third channel as well
+    StatsAccumulator stats = reduceRows<StatsAccumulator>(
+            view1.height, view1.width * view1.step,
+            [&](size_t first, size_t end) {
+                StatsAccumulator band;
+                band.update(bandOf(view1, first, end), bandOf(view2, first, end), bandOf(view2, first, end));
+                return band;
+            },
+            [](StatsAccumulator &total, const StatsAccumulator &band) { total.merge(band); });
+    return stats.finalize().correlation[0][1];
+}
@@ -0,0 +1,41 @@
+#ifndef BMPANALYZER_CHANNELVIEW_H
+#define BMPANALYZER_CHANNELVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct Histogram;
+
+// Non-owning view of one channel of an interleaved or planar image: sample x of
+// row y is data[y * rowStride + x * step]. Nothing is copied, the view is only
+// valid while the underlying buffer is.
+struct ChannelView {
+    const uint8_t *data = nullptr;
+    size_t width = 0;
+    size_t height = 0;
+    size_t step = 1;
+    size_t rowStride = 0;
+
+    uint8_t operator()(size_t x, size_t y) const {
+        return data[y * rowStride + x * step];
+    }
+
+    size_t count() const {
+        return width * height;
+    }
+
+    // Computed band-parallel on the shared ThreadPool.
+    Histogram histogram() const;
+
+    // Single-threaded histogram, for callers that already run in parallel.
+    Histogram histogramSerial() const;
+
+    double mean() const;
+
+    double standardDeviation() const;
+};
+
+// Pearson correlation of two views of the same size.
+double correlation(const ChannelView &view1, const ChannelView &view2);
+
+#endif //BMPANALYZER_CHANNELVIEW_H
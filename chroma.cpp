@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "chroma.h"
+#include "divider.h"
+#include "planarimage.h"
+#include "threadpool.h"
+
+SubsampledImage SubsampledImage::subsample(const ImageView &yCbCr, ChromaSubsampling factors) {
+    if (factors.horizontal <= 0 || factors.vertical <= 0 || factors.horizontal * factors.vertical > 65535) {
+        throw std::runtime_error("Invalid subsampling factors");
+    }
+    auto blockWidth = static_cast<size_t>(factors.horizontal);
+    auto blockHeight = static_cast<size_t>(factors.vertical);
+    size_t width = yCbCr.width;
+    size_t height = yCbCr.height;
+    size_t chromaWidth = (width + blockWidth - 1) / blockWidth;
+    size_t chromaHeight = (height + blockHeight - 1) / blockHeight;
+
+    SubsampledImage image;
+    image.subsampling = factors;
+    for (int c = 0; c < 3; ++c) {
+        image.planeWidth[c] = c == 0 ? width : chromaWidth;
+        image.planeHeight[c] = c == 0 ? height : chromaHeight;
+        image.planes[c].resize(image.planeWidth[c] * image.planeHeight[c]);
+    }
+
+    // Every chroma row covers blockHeight source rows: Y goes straight to its
+    // plane, Cb and Cr are summed down the columns and then across each block.
+    parallelRows(chromaHeight, width * 3 * blockHeight, [&](size_t first, size_t end) {
+        std::vector<uint8_t> rows[2] = {std::vector<uint8_t>(width), std::vector<uint8_t>(width)};
+        std::vector<uint32_t> columns[2] = {std::vector<uint32_t>(width), std::vector<uint32_t>(width)};
+
+        for (size_t cy = first; cy < end; ++cy) {
+            size_t firstRow = cy * blockHeight;
+            size_t rowCount = std::min(blockHeight, height - firstRow);
+            for (auto &column: columns) {
+                std::fill(column.begin(), column.end(), 0);
+            }
+            for (size_t y = firstRow; y < firstRow + rowCount; ++y) {
+                deinterleavePixels(yCbCr.row(y), image.planes[0].data() + y * width,
+                                   rows[0].data(), rows[1].data(), width);
+                for (int c = 0; c < 2; ++c) {
+                    for (size_t x = 0; x < width; ++x) {
+                        columns[c][x] += rows[c][x];
+                    }
+                }
+            }
+
+            // full blocks share one divisor, applied as a multiplication
+            size_t fullBlocks = width / blockWidth;
+            RoundedDivider divider(static_cast<uint32_t>(blockWidth * rowCount));
+            for (int c = 0; c < 2; ++c) {
+                const uint32_t *in = columns[c].data();
+                uint8_t *out = image.planes[c + 1].data() + cy * chromaWidth;
+                if (blockWidth == 2) {
+                    for (size_t cx = 0; cx < fullBlocks; ++cx) {
+                        out[cx] = divider(in[2 * cx] + in[2 * cx + 1]);
+                    }
+                } else {
+                    for (size_t cx = 0; cx < fullBlocks; ++cx) {
+                        uint32_t sum = 0;
+                        for (size_t k = 0; k < blockWidth; ++k) {
+                            sum += in[cx * blockWidth + k];
+                        }
+                        out[cx] = divider(sum);
+                    }
+                }
+                if (fullBlocks < chromaWidth) {
+                    size_t columnCount = width - fullBlocks * blockWidth;
+                    uint32_t sum = 0;
+                    for (size_t x = fullBlocks * blockWidth; x < width; ++x) {
+                        sum += in[x];
+                    }
+                    auto count = static_cast<uint32_t>(columnCount * rowCount);
+                    out[fullBlocks] = static_cast<uint8_t>((sum + count / 2) / count);
+                }
+            }
+        }
+    });
+    return image;
+}
+
+void SubsampledImage::upsample(const MutableImageView &yCbCr) const {
+    if (yCbCr.width != width() || yCbCr.height != height()) {
+        throw std::runtime_error("Image size does not match");
+    }
+    auto blockWidth = static_cast<size_t>(subsampling.horizontal);
+    auto blockHeight = static_cast<size_t>(subsampling.vertical);
+    size_t imageWidth = width();
+
+    parallelRows(height(), imageWidth * 3, [&](size_t first, size_t end) {
+        // chroma rows widened to full resolution, reused for the rows of one block
+        std::vector<uint8_t> expanded[2] = {std::vector<uint8_t>(imageWidth), std::vector<uint8_t>(imageWidth)};
+        size_t expandedRow = SIZE_MAX;
+
+        for (size_t y = first; y < end; ++y) {
+            size_t cy = y / blockHeight;
+            if (cy != expandedRow) {
+                for (int c = 0; c < 2; ++c) {
+                    const uint8_t *in = planes[c + 1].data() + cy * planeWidth[c + 1];
+                    uint8_t *out = expanded[c].data();
+                    size_t fullBlocks = imageWidth / blockWidth;
+                    if (blockWidth == 1) {
+                        std::copy(in, in + imageWidth, out);
+                    } else if (blockWidth == 2) {
+                        for (size_t cx = 0; cx < fullBlocks; ++cx) {
+                            out[2 * cx] = in[cx];
+                            out[2 * cx + 1] = in[cx];
+                        }
+                    } else {
+                        for (size_t cx = 0; cx < fullBlocks; ++cx) {
+                            std::fill_n(out + cx * blockWidth, blockWidth, in[cx]);
+                        }
+                    }
+                    if (fullBlocks * blockWidth < imageWidth) {
+                        std::fill(out + fullBlocks * blockWidth, out + imageWidth, in[fullBlocks]);
+                    }
+                }
+                expandedRow = cy;
+            }
+            interleavePixels(planes[0].data() + y * imageWidth, expanded[0].data(), expanded[1].data(),
+                             yCbCr.row(y), imageWidth);
+        }
+    });
+}
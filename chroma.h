@@ -0,0 +1,65 @@
+#ifndef BMPANALYZER_CHROMA_H
+#define BMPANALYZER_CHROMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include "aligned.h"
+#include "channelview.h"
+#include "imageview.h"
+
+// Factors by which Cb and Cr are decimated horizontally and vertically.
+struct ChromaSubsampling {
+    int horizontal = 1;
+    int vertical = 1;
+};
+
+const ChromaSubsampling chroma444{1, 1};
+const ChromaSubsampling chroma422{2, 1};
+const ChromaSubsampling chroma420{2, 2};
+const ChromaSubsampling chroma411{4, 1};
+
+// YCbCr image as a codec stores it: Y at full resolution, Cb and Cr with one
+// sample per block of horizontal x vertical pixels (the rounded mean of the
+// block; blocks at the right and bottom edges may be partial). Planes are
+// tightly packed and indexed like the bytes written by convertRGBToYCbCrPixels
+// (Y 0, Cb 1, Cr 2).
+class SubsampledImage {
+public:
+    SubsampledImage() = default;
+
+    // From interleaved YCbCr pixels as returned by convertRGBToYCbCr.
+    static SubsampledImage subsample(const ImageView &yCbCr, ChromaSubsampling factors);
+
+    // Writes full-resolution interleaved pixels, repeating every chroma sample
+    // over its block; padding bytes are left untouched.
+    void upsample(const MutableImageView &yCbCr) const;
+
+    size_t width() const {
+        return planeWidth[0];
+    }
+
+    size_t height() const {
+        return planeHeight[0];
+    }
+
+    ChromaSubsampling factors() const {
+        return subsampling;
+    }
+
+    ChannelView channel(int channel) const {
+        return {planes[channel].data(), planeWidth[channel], planeHeight[channel], 1, planeWidth[channel]};
+    }
+
+    // Bytes of sample data in all three planes.
+    size_t byteSize() const {
+        return planes[0].size() + planes[1].size() + planes[2].size();
+    }
+
+private:
+    ChromaSubsampling subsampling;
+    size_t planeWidth[3]{};
+    size_t planeHeight[3]{};
+    AlignedVector<uint8_t> planes[3];
+};
+
+#endif //BMPANALYZER_CHROMA_H
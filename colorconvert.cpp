@@ -0,0 +1,247 @@
+#include <cstring>
+#include "colorconvert.h"
+#include "simd.h"
+
+namespace {
+    // Every coefficient fits a signed 16-bit lane so the SIMD kernels can use madd.
+    const int forwardShift = 15;
+    const int forwardHalf = 1 << (forwardShift - 1);
+    const int chromaOffset = (128 << forwardShift) + forwardHalf;
+
+    // 0.299, 0.587, 0.114 scaled by 2^15; they add up to exactly 32768 so Y never exceeds 255
+    const int yR = 9798;
+    const int yG = 19235;
+    const int yB = 3735;
+    const int cbScale = 18491; // 0.5643
+    const int crScale = 23370; // 0.7132
+
+    const int inverseShift = 14;
+    const int inverseHalf = 1 << (inverseShift - 1);
+
+    const int rCr = 22970; // 1.402
+    const int gCr = 11698; // 0.714
+    const int gCb = 5472;  // 0.334
+    const int bCb = 29032; // 1.772
+
+    inline int clampByte(int value) {
+        return value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+
+    inline void forwardPixel(const uint8_t *source, uint8_t *destination) {
+        int r = source[0];
+        int g = source[1];
+        int b = source[2];
+
+        int y = (yR * r + yG * g + yB * b + forwardHalf) >> forwardShift;
+        int cb = clampByte(((b - y) * cbScale + chromaOffset) >> forwardShift);
+        int cr = clampByte(((r - y) * crScale + chromaOffset) >> forwardShift);
+
+        destination[0] = static_cast<uint8_t>(y);
+        destination[1] = static_cast<uint8_t>(cb);
+        destination[2] = static_cast<uint8_t>(cr);
+    }
+
+    inline void inversePixel(const uint8_t *source, uint8_t *destination) {
+        int y = (source[0] << inverseShift) + inverseHalf;
+        int cb = source[1] - 128;
+        int cr = source[2] - 128;
+
+        destination[0] = static_cast<uint8_t>(clampByte((y + rCr * cr) >> inverseShift));
+        destination[1] = static_cast<uint8_t>(clampByte((y - gCr * cr - gCb * cb) >> inverseShift));
+        destination[2] = static_cast<uint8_t>(clampByte((y + bCb * cb) >> inverseShift));
+    }
+
+#ifdef BMP_SSE41
+    // Thin wrappers so the same kernel body compiles for 4 (SSE4.1) and 8 (AVX2) pixels.
+    // Each pixel lives in one 32-bit lane as bytes [c0, c1, c2, 0].
+    struct Sse {
+        using Vector = __m128i;
+        static const size_t pixels = 4;
+
+        static Vector set1(int value) { return _mm_set1_epi32(value); }
+        static Vector add(Vector a, Vector b) { return _mm_add_epi32(a, b); }
+        static Vector sub(Vector a, Vector b) { return _mm_sub_epi32(a, b); }
+        static Vector bitAnd(Vector a, Vector b) { return _mm_and_si128(a, b); }
+        static Vector bitOr(Vector a, Vector b) { return _mm_or_si128(a, b); }
+        template<int n> static Vector shiftLeft(Vector a) { return _mm_slli_epi32(a, n); }
+        template<int n> static Vector shiftRightLogical(Vector a) { return _mm_srli_epi32(a, n); }
+        template<int n> static Vector shiftRight(Vector a) { return _mm_srai_epi32(a, n); }
+        // lanes must hold values in the int16 range, coefficients are 16-bit as well
+        static Vector mulShort(Vector a, int coefficient) {
+            return _mm_madd_epi16(a, _mm_set1_epi32(coefficient & 0xFFFF));
+        }
+        static Vector clamp(Vector a) {
+            return _mm_min_epi32(_mm_max_epi32(a, _mm_setzero_si128()), _mm_set1_epi32(255));
+        }
+
+        // reads 16 bytes, spreads the first 12 (4 pixels) over the 32-bit lanes
+        static Vector load(const uint8_t *source) {
+            const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source)), expand);
+        }
+
+        static __m128i compact(Vector value) {
+            const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            return _mm_shuffle_epi8(value, mask);
+        }
+
+        // writes exactly 12 bytes, so the kernels also work in place
+        static void store(uint8_t *destination, Vector value) {
+            __m128i packed = compact(value);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(destination), packed);
+            int tail = _mm_extract_epi32(packed, 2);
+            std::memcpy(destination + 8, &tail, sizeof(tail));
+        }
+    };
+
+#ifdef BMP_AVX2
+    struct Avx2 {
+        using Vector = __m256i;
+        static const size_t pixels = 8;
+
+        static Vector set1(int value) { return _mm256_set1_epi32(value); }
+        static Vector add(Vector a, Vector b) { return _mm256_add_epi32(a, b); }
+        static Vector sub(Vector a, Vector b) { return _mm256_sub_epi32(a, b); }
+        static Vector bitAnd(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+        static Vector bitOr(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+        template<int n> static Vector shiftLeft(Vector a) { return _mm256_slli_epi32(a, n); }
+        template<int n> static Vector shiftRightLogical(Vector a) { return _mm256_srli_epi32(a, n); }
+        template<int n> static Vector shiftRight(Vector a) { return _mm256_srai_epi32(a, n); }
+        static Vector mulShort(Vector a, int coefficient) {
+            return _mm256_madd_epi16(a, _mm256_set1_epi32(coefficient & 0xFFFF));
+        }
+        static Vector clamp(Vector a) {
+            return _mm256_min_epi32(_mm256_max_epi32(a, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+        }
+
+        // each 128-bit lane holds 4 pixels
+        static Vector load(const uint8_t *source) {
+            return _mm256_inserti128_si256(_mm256_castsi128_si256(Sse::load(source)), Sse::load(source + 12), 1);
+        }
+
+        static void store(uint8_t *destination, Vector value) {
+            // the low half may spill 4 bytes, they are overwritten by the high half right after
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(destination), Sse::compact(_mm256_castsi256_si128(value)));
+            Sse::store(destination + 12, _mm256_extracti128_si256(value, 1));
+        }
+    };
+#endif
+
+    template<typename Isa>
+    size_t forwardKernel(const uint8_t *source, uint8_t *destination, size_t pixelCount) {
+        using Vector = typename Isa::Vector;
+        const Vector byteMask = Isa::set1(0xFF);
+
+        size_t i = 0;
+        // the last load reads 4 bytes past the pixels it converts, stay inside the buffer
+        for (; (i + Isa::pixels) * 3 + 4 <= pixelCount * 3; i += Isa::pixels) {
+            Vector pixels = Isa::load(source + i * 3);
+            Vector r = Isa::bitAnd(pixels, byteMask);
+            Vector g = Isa::bitAnd(Isa::template shiftRightLogical<8>(pixels), byteMask);
+            Vector b = Isa::template shiftRightLogical<16>(pixels);
+
+            Vector y = Isa::add(Isa::add(Isa::mulShort(r, yR), Isa::mulShort(g, yG)),
+                                Isa::add(Isa::mulShort(b, yB), Isa::set1(forwardHalf)));
+            y = Isa::template shiftRight<forwardShift>(y);
+            Vector cb = Isa::clamp(Isa::template shiftRight<forwardShift>(
+                    Isa::add(Isa::mulShort(Isa::sub(b, y), cbScale), Isa::set1(chromaOffset))));
+            Vector cr = Isa::clamp(Isa::template shiftRight<forwardShift>(
+                    Isa::add(Isa::mulShort(Isa::sub(r, y), crScale), Isa::set1(chromaOffset))));
+
+            Isa::store(destination + i * 3, Isa::bitOr(Isa::bitOr(y, Isa::template shiftLeft<8>(cb)),
+                                                       Isa::template shiftLeft<16>(cr)));
+        }
+        return i;
+    }
+
+    template<typename Isa>
+    size_t inverseKernel(const uint8_t *source, uint8_t *destination, size_t pixelCount) {
+        using Vector = typename Isa::Vector;
+        const Vector byteMask = Isa::set1(0xFF);
+
+        size_t i = 0;
+        for (; (i + Isa::pixels) * 3 + 4 <= pixelCount * 3; i += Isa::pixels) {
+            Vector pixels = Isa::load(source + i * 3);
+            Vector y = Isa::add(Isa::template shiftLeft<inverseShift>(Isa::bitAnd(pixels, byteMask)),
+                                Isa::set1(inverseHalf));
+            Vector cb = Isa::sub(Isa::bitAnd(Isa::template shiftRightLogical<8>(pixels), byteMask), Isa::set1(128));
+            Vector cr = Isa::sub(Isa::template shiftRightLogical<16>(pixels), Isa::set1(128));
+
+            Vector r = Isa::clamp(Isa::template shiftRight<inverseShift>(Isa::add(y, Isa::mulShort(cr, rCr))));
+            Vector g = Isa::clamp(Isa::template shiftRight<inverseShift>(
+                    Isa::sub(Isa::sub(y, Isa::mulShort(cr, gCr)), Isa::mulShort(cb, gCb))));
+            Vector b = Isa::clamp(Isa::template shiftRight<inverseShift>(Isa::add(y, Isa::mulShort(cb, bCb))));
+
+            Isa::store(destination + i * 3, Isa::bitOr(Isa::bitOr(r, Isa::template shiftLeft<8>(g)),
+                                                       Isa::template shiftLeft<16>(b)));
+        }
+        return i;
+    }
+#endif
+}
+
+void convertRGBToYCbCrScalar(const uint8_t *source, uint8_t *destination, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; ++i) {
+        forwardPixel(source + i * 3, destination + i * 3);
+    }
+}
+
+void convertYCbCrToRGBScalar(const uint8_t *source, uint8_t *destination, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; ++i) {
+        inversePixel(source + i * 3, destination + i * 3);
+    }
+}
+
+void convertRGBToYCbCrPixels(const uint8_t *source, uint8_t *destination, size_t pixelCount) {
+    size_t done = 0;
+#ifdef BMP_AVX2
+    done += forwardKernel<Avx2>(source, destination, pixelCount);
+#endif
+#ifdef BMP_SSE41
+    done += forwardKernel<Sse>(source + done * 3, destination + done * 3, pixelCount - done);
+#endif
+    convertRGBToYCbCrScalar(source + done * 3, destination + done * 3, pixelCount - done);
+}
+
+void convertYCbCrToRGBPixels(const uint8_t *source, uint8_t *destination, size_t pixelCount) {
+    size_t done = 0;
+#ifdef BMP_AVX2
+    done += inverseKernel<Avx2>(source, destination, pixelCount);
+#endif
+#ifdef BMP_SSE41
+    done += inverseKernel<Sse>(source + done * 3, destination + done * 3, pixelCount - done);
+#endif
+    convertYCbCrToRGBScalar(source + done * 3, destination + done * 3, pixelCount - done);
+}
+
+void convertRGBToYCbCrPlanes(const uint8_t *__restrict r, const uint8_t *__restrict g, const uint8_t *__restrict b,
+                             uint8_t *__restrict y, uint8_t *__restrict cb, uint8_t *__restrict cr, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int luma = (yR * r[i] + yG * g[i] + yB * b[i] + forwardHalf) >> forwardShift;
+        y[i] = static_cast<uint8_t>(luma);
+        cb[i] = static_cast<uint8_t>(clampByte(((b[i] - luma) * cbScale + chromaOffset) >> forwardShift));
+        cr[i] = static_cast<uint8_t>(clampByte(((r[i] - luma) * crScale + chromaOffset) >> forwardShift));
+    }
+}
+
+void convertYCbCrToRGBPlanes(const uint8_t *__restrict y, const uint8_t *__restrict cb, const uint8_t *__restrict cr,
+                             uint8_t *__restrict r, uint8_t *__restrict g, uint8_t *__restrict b, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int luma = (y[i] << inverseShift) + inverseHalf;
+        int blue = cb[i] - 128;
+        int red = cr[i] - 128;
+        r[i] = static_cast<uint8_t>(clampByte((luma + rCr * red) >> inverseShift));
+        g[i] = static_cast<uint8_t>(clampByte((luma - gCr * red - gCb * blue) >> inverseShift));
+        b[i] = static_cast<uint8_t>(clampByte((luma + bCb * blue) >> inverseShift));
+    }
+}
+
+const char *colorConvertIsa() {
+#if defined(BMP_AVX2)
+    return "AVX2";
+#elif defined(BMP_SSE41)
+    return "SSE4.1";
+#else
+    return "scalar";
+#endif
+}
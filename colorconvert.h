@@ -0,0 +1,33 @@
+#ifndef BMPANALYZER_COLORCONVERT_H
+#define BMPANALYZER_COLORCONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-point colour conversion of interleaved 3-byte pixels (15 fractional bits
+// forward, 14 back). The SSE4.1/AVX2 kernels and the scalar fallback produce identical bytes,
+// and source and destination may be the same buffer.
+//
+// The byte order matches BMP::convertRGBToYCbCr: pixel bytes 0, 1, 2 are read
+// as r, g, b and written as Y, Cb, Cr (and the other way round for the inverse).
+
+void convertRGBToYCbCrPixels(const uint8_t *source, uint8_t *destination, size_t pixelCount);
+
+void convertYCbCrToRGBPixels(const uint8_t *source, uint8_t *destination, size_t pixelCount);
+
+void convertRGBToYCbCrScalar(const uint8_t *source, uint8_t *destination, size_t pixelCount);
+
+void convertYCbCrToRGBScalar(const uint8_t *source, uint8_t *destination, size_t pixelCount);
+
+// Planar variants with the same arithmetic; contiguous planes need no shuffles
+// and the plain loops are left to the compiler's vectorizer. Planes must not overlap.
+void convertRGBToYCbCrPlanes(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                             uint8_t *y, uint8_t *cb, uint8_t *cr, size_t count);
+
+void convertYCbCrToRGBPlanes(const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                             uint8_t *r, uint8_t *g, uint8_t *b, size_t count);
+
+// Name of the instruction set the kernels were compiled for.
+const char *colorConvertIsa();
+
+#endif //BMPANALYZER_COLORCONVERT_H
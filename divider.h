@@ -0,0 +1,20 @@
+#ifndef BMPANALYZER_DIVIDER_H
+#define BMPANALYZER_DIVIDER_H
+
+#include <cstdint>
+
+// Rounded division of block sums (below 2^24) by a fixed count (below 2^16):
+// with a 40-bit reciprocal rounded up, the product's top bits are the exact quotient.
+struct RoundedDivider {
+    uint32_t half;
+    uint64_t reciprocal;
+
+    explicit RoundedDivider(uint32_t divisor)
+            : half(divisor / 2), reciprocal(((uint64_t{1} << 40) + divisor - 1) / divisor) {}
+
+    uint8_t operator()(uint32_t sum) const {
+        return static_cast<uint8_t>(((sum + half) * reciprocal) >> 40);
+    }
+};
+
+#endif //BMPANALYZER_DIVIDER_H
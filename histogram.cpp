@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "histogram.h"
+
+namespace {
+    // Each channel is counted into four sub-histograms picked by pixel index, so
+    // runs of equal values do not serialize on the same counter (store-to-load stalls).
+    const int subHistograms = 4;
+    // 32-bit sub-histogram counters are flushed before they can overflow.
+    const size_t flushPixels = size_t{1} << 24;
+
+    inline uint64_t loadWord(const uint8_t *p) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    inline uint32_t byteAt(uint64_t word, int i) {
+        return static_cast<uint32_t>(word >> (i * 8)) & 0xFF;
+    }
+
+    using SubHistograms = uint32_t[3][subHistograms][256];
+
+    void countPixels(const uint8_t *pixels, size_t count, SubHistograms &sub) {
+        size_t i = 0;
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // 8 pixels are exactly three 64-bit words, so the channel of every byte is fixed:
+        // w0 = b0 g0 r0 b1 g1 r1 b2 g2, w1 = r2 b3 g3 r3 b4 g4 r4 b5, w2 = g5 r5 b6 g6 r6 b7 g7 r7
+        for (; i + 8 <= count; i += 8) {
+            const uint8_t *p = pixels + i * 3;
+            uint64_t w0 = loadWord(p);
+            uint64_t w1 = loadWord(p + 8);
+            uint64_t w2 = loadWord(p + 16);
+
+            ++sub[0][0][byteAt(w0, 0)];
+            ++sub[1][0][byteAt(w0, 1)];
+            ++sub[2][0][byteAt(w0, 2)];
+            ++sub[0][1][byteAt(w0, 3)];
+            ++sub[1][1][byteAt(w0, 4)];
+            ++sub[2][1][byteAt(w0, 5)];
+            ++sub[0][2][byteAt(w0, 6)];
+            ++sub[1][2][byteAt(w0, 7)];
+
+            ++sub[2][2][byteAt(w1, 0)];
+            ++sub[0][3][byteAt(w1, 1)];
+            ++sub[1][3][byteAt(w1, 2)];
+            ++sub[2][3][byteAt(w1, 3)];
+            ++sub[0][0][byteAt(w1, 4)];
+            ++sub[1][0][byteAt(w1, 5)];
+            ++sub[2][0][byteAt(w1, 6)];
+            ++sub[0][1][byteAt(w1, 7)];
+
+            ++sub[1][1][byteAt(w2, 0)];
+            ++sub[2][1][byteAt(w2, 1)];
+            ++sub[0][2][byteAt(w2, 2)];
+            ++sub[1][2][byteAt(w2, 3)];
+            ++sub[2][2][byteAt(w2, 4)];
+            ++sub[0][3][byteAt(w2, 5)];
+            ++sub[1][3][byteAt(w2, 6)];
+            ++sub[2][3][byteAt(w2, 7)];
+        }
+#endif
+        for (; i < count; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                ++sub[c][i % subHistograms][pixels[i * 3 + c]];
+            }
+        }
+    }
+
+    void flush(SubHistograms &sub, ChannelHistograms &histograms) {
+        for (int c = 0; c < 3; ++c) {
+            for (int v = 0; v < 256; ++v) {
+                histograms.channel[c].bins[v] += uint64_t{sub[c][0][v]} + sub[c][1][v] + sub[c][2][v] + sub[c][3][v];
+            }
+        }
+        std::memset(sub, 0, sizeof(sub));
+    }
+}
+
+uint64_t Histogram::count() const {
+    uint64_t total = 0;
+    for (uint64_t bin: bins) {
+        total += bin;
+    }
+    return total;
+}
+
+double Histogram::mean() const {
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    for (int v = 0; v < 256; ++v) {
+        total += bins[v];
+        sum += bins[v] * v;
+    }
+    return total > 0 ? static_cast<double>(sum) / static_cast<double>(total) : 0;
+}
+
+double Histogram::variance() const {
+    uint64_t total = count();
+    if (total < 2) {
+        return 0;
+    }
+    double average = mean();
+    double sum = 0;
+    for (int v = 0; v < 256; ++v) {
+        double tmp = v - average;
+        sum += static_cast<double>(bins[v]) * tmp * tmp;
+    }
+    return sum / static_cast<double>(total - 1);
+}
+
+double Histogram::standardDeviation() const {
+    return std::sqrt(variance());
+}
+
+double Histogram::entropy() const {
+    auto total = static_cast<double>(count());
+    double result = 0;
+    for (uint64_t bin: bins) {
+        if (bin > 0) {
+            double p = static_cast<double>(bin) / total;
+            result -= p * std::log2(p);
+        }
+    }
+    return result;
+}
+
+void Histogram::merge(const Histogram &other) {
+    for (int v = 0; v < 256; ++v) {
+        bins[v] += other.bins[v];
+    }
+}
+
+void ChannelHistograms::merge(const ChannelHistograms &other) {
+    for (int c = 0; c < 3; ++c) {
+        channel[c].merge(other.channel[c]);
+    }
+}
+
+void ChannelHistograms::add(const uint8_t *pixels, size_t pixelCount) {
+    add(ImageView(pixels, pixelCount, 1, pixelCount * 3));
+}
+
+void ChannelHistograms::add(const ImageView &image) {
+    SubHistograms sub;
+    std::memset(sub, 0, sizeof(sub));
+    size_t counted = 0;
+
+    // padding-free rows are counted as one long row
+    size_t width = image.contiguous() ? image.count() : image.width;
+    size_t rows = image.contiguous() ? std::min<size_t>(image.height, 1) : image.height;
+    for (size_t row = 0; row < rows; ++row) {
+        const uint8_t *rowPixels = image.row(row);
+        size_t remaining = width;
+        while (remaining > 0) {
+            if (counted == flushPixels) {
+                flush(sub, *this);
+                counted = 0;
+            }
+            size_t chunk = std::min(remaining, flushPixels - counted);
+            countPixels(rowPixels, chunk, sub);
+            rowPixels += chunk * 3;
+            remaining -= chunk;
+            counted += chunk;
+        }
+    }
+    flush(sub, *this);
+}
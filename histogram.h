@@ -0,0 +1,37 @@
+#ifndef BMPANALYZER_HISTOGRAM_H
+#define BMPANALYZER_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include "imageview.h"
+
+// 256-bin histogram of one 8-bit channel. Every moment of the channel can be
+// computed exactly from it without touching the pixels again.
+struct Histogram {
+    uint64_t bins[256]{};
+
+    uint64_t count() const;
+
+    double mean() const;
+
+    double variance() const; // sample variance, divided by count - 1
+
+    double standardDeviation() const;
+
+    double entropy() const; // in bits per sample
+
+    void merge(const Histogram &other);
+};
+
+struct ChannelHistograms {
+    Histogram channel[3];
+
+    // Adds pixelCount interleaved 3-byte pixels.
+    void add(const uint8_t *pixels, size_t pixelCount);
+
+    void add(const ImageView &image);
+
+    void merge(const ChannelHistograms &other);
+};
+
+#endif //BMPANALYZER_HISTOGRAM_H
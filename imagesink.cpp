@@ -0,0 +1,16 @@
+#include "bmp.h"
+#include "imagesink.h"
+
+void DirectorySink::write(BMP &image, const std::string &name, std::vector<uint8_t> &data) {
+    createNewDir(dir);
+    if (writer != nullptr) {
+        image.saveFile(dir + "/" + name, data, *writer);
+    } else {
+        image.saveFile(dir + "/" + name, data);
+    }
+}
+
+void DirectorySink::writeGray(BMP &image, const std::string &name, const ChannelView &channel) {
+    createNewDir(dir);
+    image.saveFileGray(dir + "/" + name, channel, Encoding::Raw, writer);
+}
@@ -0,0 +1,42 @@
+#ifndef BMPANALYZER_IMAGESINK_H
+#define BMPANALYZER_IMAGESINK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class AsyncWriter;
+
+class BMP;
+
+struct ChannelView;
+
+// Destination for the intermediate images produced by the conversions.
+// Without a sink the conversions only return their result in memory.
+class ImageSink {
+public:
+    virtual ~ImageSink() = default;
+
+    // data has the layout of image's pixel array, name carries no extension
+    virtual void write(BMP &image, const std::string &name, std::vector<uint8_t> &data) = 0;
+
+    // Single-channel images, written as 8-bit grayscale
+    virtual void writeGray(BMP &image, const std::string &name, const ChannelView &channel) = 0;
+};
+
+// Saves every image as <dir>/<name>.bmp, creating dir on first use. With a
+// writer the files are queued on it and write returns without waiting.
+class DirectorySink : public ImageSink {
+public:
+    explicit DirectorySink(std::string dir, AsyncWriter *writer = nullptr) : dir(std::move(dir)), writer(writer) {}
+
+    void write(BMP &image, const std::string &name, std::vector<uint8_t> &data) override;
+
+    void writeGray(BMP &image, const std::string &name, const ChannelView &channel) override;
+
+private:
+    std::string dir;
+    AsyncWriter *writer;
+};
+
+#endif //BMPANALYZER_IMAGESINK_H
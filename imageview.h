@@ -0,0 +1,70 @@
+#ifndef BMPANALYZER_IMAGEVIEW_H
+#define BMPANALYZER_IMAGEVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include "channelview.h"
+
+// Non-owning view of interleaved 3-byte pixels: pixel x of row y starts at
+// data + y * stride + x * 3. Rows may carry padding (BMP rows are 4-byte
+// aligned) and a view may be a crop of a larger image, nothing is copied.
+template<typename T>
+struct BasicImageView {
+    T *data = nullptr;
+    size_t width = 0;
+    size_t height = 0;
+    size_t stride = 0;
+
+    BasicImageView() = default;
+
+    BasicImageView(T *data, size_t width, size_t height, size_t stride)
+            : data(data), width(width), height(height), stride(stride) {}
+
+    // A writable view converts to a read-only one.
+    template<typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    BasicImageView(const BasicImageView<U> &other)
+            : data(other.data), width(other.width), height(other.height), stride(other.stride) {}
+
+    T *row(size_t y) const {
+        return data + y * stride;
+    }
+
+    T *pixel(size_t x, size_t y) const {
+        return row(y) + x * 3;
+    }
+
+    size_t count() const {
+        return width * height;
+    }
+
+    // True when the rows follow each other without padding.
+    bool contiguous() const {
+        return stride == width * 3 || height <= 1;
+    }
+
+    // Sub-region starting at pixel (x, y); shares the pixels of this view.
+    BasicImageView crop(size_t x, size_t y, size_t cropWidth, size_t cropHeight) const {
+        if (x + cropWidth > width || y + cropHeight > height) {
+            throw std::runtime_error("Crop outside the image");
+        }
+        return {pixel(x, y), cropWidth, cropHeight, stride};
+    }
+
+    // Rows [first, end) of this view.
+    BasicImageView rows(size_t first, size_t end) const {
+        return crop(0, first, width, end - first);
+    }
+
+    // Channel index as returned by getIndexComponent.
+    ChannelView channel(int index) const {
+        return {data + index, width, height, 3, stride};
+    }
+};
+
+using ImageView = BasicImageView<const uint8_t>;
+
+using MutableImageView = BasicImageView<uint8_t>;
+
+#endif //BMPANALYZER_IMAGEVIEW_H
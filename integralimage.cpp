@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <stdexcept>
+#include "integralimage.h"
+#include "threadpool.h"
+
+IntegralImage::IntegralImage(const ImageView &image)
+        : imageWidth(image.width), imageHeight(image.height),
+          table((image.width + 1) * (image.height + 1) * termCount, 0) {
+    const size_t entries = imageWidth + 1;
+    const size_t rowTerms = entries * termCount;
+
+    // Each thread takes one band of rows and accumulates it as if it were the
+    // whole image: running sums along the row plus the corner row above.
+    ThreadPool &pool = ThreadPool::instance();
+    size_t bands = std::min<size_t>(pool.size(), std::max<size_t>(1, imageHeight));
+    size_t bandRows = (imageHeight + bands - 1) / std::max<size_t>(1, bands);
+    auto bandEnd = [&](size_t band) { return std::min(imageHeight, (band + 1) * bandRows); };
+
+    pool.parallelFor(bands, [&](size_t band) {
+        for (size_t y = band * bandRows; y < bandEnd(band); ++y) {
+            const uint8_t *in = image.row(y);
+            // the first row of a band starts from zero and is corrected below
+            const uint64_t *above = table.data() + (y == band * bandRows ? 0 : y * rowTerms) + termCount;
+            uint64_t *out = table.data() + (y + 1) * rowTerms + termCount;
+            uint64_t running[termCount]{};
+            for (size_t x = 0; x < imageWidth; ++x, in += 3, out += termCount, above += termCount) {
+                uint32_t c0 = in[0];
+                uint32_t c1 = in[1];
+                uint32_t c2 = in[2];
+                uint32_t terms[termCount] = {c0, c1, c2, c0 * c0, c0 * c1, c0 * c2, c1 * c1, c1 * c2, c2 * c2};
+                for (size_t t = 0; t < termCount; ++t) {
+                    running[t] += terms[t];
+                    out[t] = running[t] + above[t];
+                }
+            }
+        }
+    });
+
+    // Every band after the first still lacks the totals of the bands above it:
+    // fix the last rows in order, then add the corrections to the other rows in parallel.
+    for (size_t band = 1; band < bands && band * bandRows < imageHeight; ++band) {
+        const uint64_t *offset = table.data() + band * bandRows * rowTerms;
+        uint64_t *last = table.data() + bandEnd(band) * rowTerms;
+        for (size_t t = 0; t < rowTerms; ++t) {
+            last[t] += offset[t];
+        }
+    }
+    pool.parallelFor(bands, [&](size_t band) {
+        if (band == 0 || band * bandRows >= imageHeight) {
+            return;
+        }
+        const uint64_t *offset = table.data() + band * bandRows * rowTerms;
+        for (size_t y = band * bandRows + 1; y < bandEnd(band); ++y) {
+            uint64_t *row = table.data() + y * rowTerms;
+            for (size_t t = 0; t < rowTerms; ++t) {
+                row[t] += offset[t];
+            }
+        }
+    });
+}
+
+StatsAccumulator IntegralImage::sums(const Region &region) const {
+    if (region.x + region.width > imageWidth || region.y + region.height > imageHeight) {
+        throw std::runtime_error("Region outside the image");
+    }
+    const uint64_t *topLeft = corner(region.x, region.y);
+    const uint64_t *topRight = corner(region.x + region.width, region.y);
+    const uint64_t *bottomLeft = corner(region.x, region.y + region.height);
+    const uint64_t *bottomRight = corner(region.x + region.width, region.y + region.height);
+
+    uint64_t terms[termCount];
+    for (size_t t = 0; t < termCount; ++t) {
+        terms[t] = bottomRight[t] - topRight[t] - bottomLeft[t] + topLeft[t];
+    }
+
+    StatsAccumulator result;
+    result.count = region.width * region.height;
+    for (int c = 0; c < 3; ++c) {
+        result.sum[c] = terms[c];
+    }
+    result.sumProduct[0][0] = terms[3];
+    result.sumProduct[0][1] = terms[4];
+    result.sumProduct[0][2] = terms[5];
+    result.sumProduct[1][1] = terms[6];
+    result.sumProduct[1][2] = terms[7];
+    result.sumProduct[2][2] = terms[8];
+    return result;
+}
+
+ChannelStats IntegralImage::stats(const Region &region) const {
+    return sums(region).finalize();
+}
+
+std::vector<ChannelStats> IntegralImage::stats(const std::vector<Region> &regions) const {
+    std::vector<ChannelStats> results(regions.size());
+    const size_t blockSize = 4096;
+    size_t blocks = (regions.size() + blockSize - 1) / blockSize;
+    ThreadPool::instance().parallelFor(blocks, [&](size_t block) {
+        size_t end = std::min(regions.size(), (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; ++i) {
+            results[i] = stats(regions[i]);
+        }
+    });
+    return results;
+}
@@ -1,39 +1,181 @@
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <thread>
+#include "asyncwriter.h"
+#include "batch.h"
 #include "bmp.h"
+#include "imagesink.h"
+#include "threadpool.h"
+
+namespace {
+    // Files named by a directory or list; a missing or unreadable input is
+    // reported on stderr and leaves files untouched.
+    bool loadBatchInputs(const char *path, std::vector<std::string> &files) {
+        try {
+            files = collectBatchInputs(path);
+            return true;
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    // BmpAnalyzer --batch <directory|list> [--jobs N] [--readers N] [--output results.csv]
+    int runBatchMode(int argc, char *argv[]) {
+        BatchOptions options;
+        options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        std::string output;
+
+        for (int i = 3; i < argc; i += 2) {
+            const char *option = argv[i];
+            if (std::strcmp(option, "--jobs") != 0 && std::strcmp(option, "--readers") != 0 &&
+                std::strcmp(option, "--output") != 0) {
+                std::cerr << "Unknown option: " << option << std::endl;
+                return 1;
+            }
+            if (i + 1 == argc) {
+                std::cerr << "Missing value for option: " << option << std::endl;
+                return 1;
+            }
+            const char *value = argv[i + 1];
+            if (std::strcmp(option, "--jobs") == 0) {
+                options.jobs = static_cast<unsigned>(std::max(1, std::atoi(value)));
+            } else if (std::strcmp(option, "--readers") == 0) {
+                options.readers = static_cast<unsigned>(std::max(1, std::atoi(value)));
+            } else {
+                output = value;
+            }
+        }
+
+        std::vector<std::string> files;
+        if (!loadBatchInputs(argv[2], files)) {
+            return 1;
+        }
+
+        // images are the unit of parallelism here, so the kernels run on the calling thread
+        ThreadPool::setThreadCount(1);
+
+        if (output.empty()) {
+            runBatch(files, std::cout, options);
+            return 0;
+        }
+        std::ofstream file(output);
+        if (!file.is_open()) {
+            std::cerr << "Error opening file: " << output << std::endl;
+            return 1;
+        }
+        runBatch(files, file, options);
+        return 0;
+    }
+
+    // BmpAnalyzer --index <directory|list> [--output index.csv]
+    int runIndexMode(int argc, char *argv[]) {
+        if (argc > 3 && std::strcmp(argv[3], "--output") != 0) {
+            std::cerr << "Unknown option: " << argv[3] << std::endl;
+            return 1;
+        }
+        if (argc == 4) {
+            std::cerr << "Missing value for option: " << argv[3] << std::endl;
+            return 1;
+        }
+        if (argc > 5) {
+            std::cerr << "Unknown option: " << argv[5] << std::endl;
+            return 1;
+        }
+        std::vector<std::string> files;
+        if (!loadBatchInputs(argv[2], files)) {
+            return 1;
+        }
+        if (argc < 5) {
+            writeIndex(files, std::cout);
+            return 0;
+        }
+        std::ofstream file(argv[4]);
+        if (!file.is_open()) {
+            std::cerr << "Error opening file: " << argv[4] << std::endl;
+            return 1;
+        }
+        writeIndex(files, file);
+        return 0;
+    }
+}
 
 //4ea
-int main() {
-    BMP bmp("kodim15.bmp");
-    bmp.saveFile("SAVE.bmp");
-    bmp.saveFileByComponents("component");
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && std::strcmp(argv[1], "--batch") == 0) {
+        return runBatchMode(argc, argv);
+    }
+    if (argc >= 3 && std::strcmp(argv[1], "--index") == 0) {
+        return runIndexMode(argc, argv);
+    }
+
+    // output files are written in the background while the statistics are computed
+    AsyncWriter writer;
 
-    std::cout << "Coefficient correl between b and g: " << bmp.countCorrelCoef('b', 'g', bmp.getData()) << "\n";
-    std::cout << "Coefficient correl between r and g: " << bmp.countCorrelCoef('r', 'g', bmp.getData()) << "\n";
-    std::cout << "Coefficient correl between b and r: " << bmp.countCorrelCoef('b', 'r', bmp.getData()) << "\n";
+    BMP bmp("kodim15.bmp", LoadMode::Map);
+    bmp.saveFile("SAVE.bmp", writer);
+    bmp.saveFileByComponents("component", Encoding::Raw, &writer);
 
+    auto rgbStats = bmp.countStats(bmp.getData());
+
+    std::cout << "Coefficient correl between b and g: " << rgbStats.correlationOf('b', 'g') << "\n";
+    std::cout << "Coefficient correl between r and g: " << rgbStats.correlationOf('r', 'g') << "\n";
+    std::cout << "Coefficient correl between b and r: " << rgbStats.correlationOf('b', 'r') << "\n";
+
+    writer.flush();
     BMP bmpR("component/Rcomponent.bmp");
     BMP bmpB("component/Bcomponent.bmp");
 
 //    std::cout<<bmp.countPSNR(bmpB.getData(), bmpR.getData(), 'g') << "\n";
 
-    auto yCbCr = bmp.convertRGBToYCbCr();
+    DirectorySink yCbCrDir("YCbCr", &writer);
+    auto yCbCr = bmp.convertRGBToYCbCr(&yCbCrDir);
+
+    auto yCbCrStats = bmp.countStats(yCbCr);
+
+    std::cout << "Coefficient correl between Cr and Rb: " << yCbCrStats.correlationOf('R', 'B') << "\n";
+    std::cout << "Coefficient correl between Cr and Y : " << yCbCrStats.correlationOf('R', 'Y') << "\n";
+    std::cout << "Coefficient correl between Y  and Cb: " << yCbCrStats.correlationOf('Y', 'B') << "\n";
 
-    std::cout << "Coefficient correl between Cr and Rb: " << bmp.countCorrelCoef('R', 'B', yCbCr) << "\n";
-    std::cout << "Coefficient correl between Cr and Y : " << bmp.countCorrelCoef('R', 'Y', yCbCr) << "\n";
-    std::cout << "Coefficient correl between Y  and Cb: " << bmp.countCorrelCoef('Y', 'B', yCbCr) << "\n";
 
+    DirectorySink rgbDir("RGB", &writer);
+    auto rgbRecovered = bmp.convertYbCrToRGB(yCbCr, &rgbDir);
 
-    auto rgbRecovered = bmp.convertYbCrToRGB(yCbCr);
+    auto errors = bmp.countErrors(bmp.getData(), rgbRecovered);
 
-    std::cout << "PSNR r: " << bmp.countPSNR(bmp.getData(), rgbRecovered, 'r') << "\n";
-    std::cout << "PSNR b: " << bmp.countPSNR(bmp.getData(), rgbRecovered, 'b') << "\n";
-    std::cout << "PSNR g: " << bmp.countPSNR(bmp.getData(), rgbRecovered, 'g') << "\n";
+    std::cout << "PSNR r: " << errors.psnrOf('r') << "\n";
+    std::cout << "PSNR b: " << errors.psnrOf('b') << "\n";
+    std::cout << "PSNR g: " << errors.psnrOf('g') << "\n";
 
+    // 4:2:0 as a codec stores it: Y stays at full resolution, Cb and Cr lose three quarters
+    auto subsampled = bmp.subsampleChroma(yCbCr, chroma420);
+    auto rgb420 = bmp.convertYbCrToRGB(bmp.upsampleChroma(subsampled));
+    auto errors420 = bmp.countErrors(bmp.getData(), rgb420);
+
+    std::cout << "YCbCr 4:2:0 bytes: " << subsampled.byteSize() << " of " << yCbCr.size() << "\n";
+    std::cout << "PSNR r 4:2:0: " << errors420.psnrOf('r') << "\n";
+    std::cout << "PSNR b 4:2:0: " << errors420.psnrOf('b') << "\n";
+    std::cout << "PSNR g 4:2:0: " << errors420.psnrOf('g') << "\n";
+
+    writer.flush();
     BMP forDecimateEven("YCbCr/YCbCr.bmp");
     forDecimateEven.decimateImageEven(2);
 
     BMP forDecimateAvg("YCbCr/YCbCr.bmp");
     forDecimateAvg.decimateImageAvg();
 
+    BMP forDecimateBox("YCbCr/YCbCr.bmp");
+    forDecimateBox.decimateImageBox(2, 2);
+
     forDecimateEven.restoreImage(2);
+
+    // the box-decimated image enlarged back with each resampling filter
+    BMP original("YCbCr/YCbCr.bmp");
+    for (ResampleFilter filter: {ResampleFilter::Bilinear, ResampleFilter::Bicubic, ResampleFilter::Lanczos3}) {
+        BMP restored = forDecimateBox;
+        restored.restoreImage(2, filter);
+        auto restoredErrors = original.countErrors(original.getData(), restored.getData());
+        std::cout << "PSNR restored " << resampleFilterName(filter) << ": " << restoredErrors.totalPsnr << "\n";
+    }
 }
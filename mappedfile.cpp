@@ -0,0 +1,96 @@
+#include <stdexcept>
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filename) {
+    fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        throw std::runtime_error("Error opening file");
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        CloseHandle(fileHandle);
+        throw std::runtime_error("Error reading file size");
+    }
+    length = static_cast<size_t>(fileSize.QuadPart);
+    if (length == 0) {
+        return;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        CloseHandle(fileHandle);
+        throw std::runtime_error("Error mapping file");
+    }
+
+    begin = static_cast<const uint8_t *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (begin == nullptr) {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        throw std::runtime_error("Error mapping file");
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (begin != nullptr) {
+        UnmapViewOfFile(begin);
+    }
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != nullptr) {
+        CloseHandle(fileHandle);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename) {
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening file");
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Error reading file size");
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length == 0) {
+        return;
+    }
+
+    void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Error mapping file");
+    }
+    // Analysis walks the pixels front to back, let the kernel read ahead.
+    madvise(address, length, MADV_SEQUENTIAL);
+    begin = static_cast<const uint8_t *>(address);
+}
+
+MappedFile::~MappedFile() {
+    if (begin != nullptr) {
+        munmap(const_cast<uint8_t *>(begin), length);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+#endif
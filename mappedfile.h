@@ -0,0 +1,39 @@
+#ifndef BMPANALYZER_MAPPEDFILE_H
+#define BMPANALYZER_MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are faulted in lazily,
+// so opening a large file costs almost nothing until its bytes are touched.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const {
+        return begin;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const uint8_t *begin = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+#endif //BMPANALYZER_MAPPEDFILE_H
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "pixelformat.h"
+#include "planarimage.h"
+#include "simd.h"
+#include "threadpool.h"
+
+namespace {
+    // Expands a 5- or 6-bit field to 8 bits by bit replication.
+    template<int Bits>
+    inline uint8_t expand(uint32_t value) {
+        return static_cast<uint8_t>((value << (8 - Bits)) | (value >> (2 * Bits - 8)));
+    }
+
+    // Indexed pixels through a 256-entry table of BGRX words. All but the last
+    // pixel of a row store four bytes and let the next pixel overwrite the fourth.
+    template<int Bits>
+    struct IndexedDecoder {
+        uint32_t table[256]{};
+
+        explicit IndexedDecoder(const std::vector<uint8_t> &colors) {
+            size_t count = std::min<size_t>(colors.size() / 4, size_t{1} << Bits);
+            std::memcpy(table, colors.data(), count * 4);
+        }
+
+        void operator()(const uint8_t *in, uint8_t *out, size_t width) const {
+            if (width == 0) {
+                return;
+            }
+            const int perByte = 8 / Bits;
+            const uint32_t mask = (1u << Bits) - 1;
+            for (size_t x = 0; x + 1 < width; ++x) {
+                uint32_t index = (in[x / perByte] >> (8 - Bits - (x % perByte) * Bits)) & mask;
+                std::memcpy(out + x * 3, &table[index], 4);
+            }
+            size_t last = width - 1;
+            uint32_t index = (in[last / perByte] >> (8 - Bits - (last % perByte) * Bits)) & mask;
+            std::memcpy(out + last * 3, &table[index], 3);
+        }
+    };
+
+    // 16-bit pixels with fixed 5-5-5 or 5-6-5 fields (blue in the low bits). The
+    // fields are unpacked into short planes, which the compiler vectorizes, and
+    // then interleaved with the planar kernel.
+    template<int GreenBits>
+    struct Rgb16Decoder {
+        void operator()(const uint8_t *in, uint8_t *out, size_t width) const {
+            const size_t chunk = 256;
+            uint8_t blue[chunk];
+            uint8_t green[chunk];
+            uint8_t red[chunk];
+            for (size_t first = 0; first < width; first += chunk) {
+                size_t count = std::min(chunk, width - first);
+                const uint8_t *pixels = in + first * 2;
+                for (size_t x = 0; x < count; ++x) {
+                    uint32_t value = pixels[x * 2] | (pixels[x * 2 + 1] << 8);
+                    blue[x] = expand<5>(value & 0x1F);
+                    green[x] = expand<GreenBits>((value >> 5) & ((1u << GreenBits) - 1));
+                    red[x] = expand<5>((value >> (5 + GreenBits)) & 0x1F);
+                }
+                interleavePixels(blue, green, red, out + first * 3, count);
+            }
+        }
+    };
+
+    // 32-bit pixels stored as B, G, R, X: drop every fourth byte.
+    struct Bgrx32Decoder {
+        void operator()(const uint8_t *in, uint8_t *out, size_t width) const {
+            size_t x = 0;
+#ifdef BMP_SSE41
+            const __m128i drop = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            // each store writes 16 bytes for 4 pixels, so stop while 2 more pixels follow
+            for (; x + 6 <= width; x += 4) {
+                __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x * 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x * 3), _mm_shuffle_epi8(pixels, drop));
+            }
+#endif
+            for (; x < width; ++x) {
+                out[x * 3] = in[x * 4];
+                out[x * 3 + 1] = in[x * 4 + 1];
+                out[x * 3 + 2] = in[x * 4 + 2];
+            }
+        }
+    };
+
+    // Any other bit-field layout: every field is shifted down and scaled to
+    // 8 bits through a table (fields wider than 8 bits keep their top 8 bits).
+    template<int Bytes>
+    struct MaskedDecoder {
+        uint32_t masks[3]{};
+        int shifts[3]{};
+        uint8_t scale[3][256]{};
+
+        explicit MaskedDecoder(const uint32_t (&fieldMasks)[3]) {
+            for (int c = 0; c < 3; ++c) {
+                uint32_t mask = fieldMasks[c];
+                int shift = 0;
+                int bits = 0;
+                if (mask != 0) {
+                    while (!(mask >> shift & 1)) {
+                        ++shift;
+                    }
+                    while (shift + bits < 32 && (mask >> (shift + bits) & 1)) {
+                        ++bits;
+                    }
+                }
+                if (bits > 8) {
+                    shift += bits - 8;
+                    bits = 8;
+                }
+                masks[c] = bits > 0 ? ((1u << bits) - 1) << shift : 0;
+                shifts[c] = shift;
+                uint32_t maximum = (1u << bits) - 1;
+                for (uint32_t v = 0; v <= maximum && bits > 0; ++v) {
+                    scale[c][v] = static_cast<uint8_t>((v * 255 + maximum / 2) / maximum);
+                }
+            }
+        }
+
+        void operator()(const uint8_t *in, uint8_t *out, size_t width) const {
+            for (size_t x = 0; x < width; ++x) {
+                uint32_t value = 0;
+                std::memcpy(&value, in + x * Bytes, Bytes);
+                // output bytes are blue, green, red; the masks are red, green, blue
+                out[x * 3] = scale[2][(value & masks[2]) >> shifts[2]];
+                out[x * 3 + 1] = scale[1][(value & masks[1]) >> shifts[1]];
+                out[x * 3 + 2] = scale[0][(value & masks[0]) >> shifts[0]];
+            }
+        }
+    };
+
+    struct Bgr24Decoder {
+        void operator()(const uint8_t *in, uint8_t *out, size_t width) const {
+            std::memcpy(out, in, width * 3);
+        }
+    };
+
+    template<typename Decoder>
+    void decodeRows(const Decoder &decoder, const uint8_t *source, size_t sourceStride,
+                    uint8_t *destination, size_t destinationStride, size_t width, size_t height) {
+        parallelRows(height, destinationStride, [&](size_t first, size_t end) {
+            for (size_t y = first; y < end; ++y) {
+                decoder(source + y * sourceStride, destination + y * destinationStride, width);
+            }
+        });
+    }
+
+    bool hasMasks(const PixelFormat &format, uint32_t red, uint32_t green, uint32_t blue) {
+        return format.masks[0] == red && format.masks[1] == green && format.masks[2] == blue;
+    }
+}
+
+void decodeToBgr24(const PixelFormat &format, const uint8_t *source, size_t sourceStride,
+                   uint8_t *destination, size_t destinationStride, size_t width, size_t height) {
+    bool bitFields = format.compression == compressionBitFields || format.compression == compressionAlphaBitFields;
+    if (format.compression != compressionRgb && !bitFields) {
+        throw std::runtime_error("Unsupported BMP compression");
+    }
+    auto decode = [&](const auto &decoder) {
+        decodeRows(decoder, source, sourceStride, destination, destinationStride, width, height);
+    };
+
+    switch (format.bitCount) {
+        case 1:
+            decode(IndexedDecoder<1>(format.colors));
+            return;
+        case 4:
+            decode(IndexedDecoder<4>(format.colors));
+            return;
+        case 8:
+            decode(IndexedDecoder<8>(format.colors));
+            return;
+        case 16:
+            if (!bitFields || hasMasks(format, 0x7C00, 0x03E0, 0x001F)) {
+                decode(Rgb16Decoder<5>());
+            } else if (hasMasks(format, 0xF800, 0x07E0, 0x001F)) {
+                decode(Rgb16Decoder<6>());
+            } else {
+                decode(MaskedDecoder<2>(format.masks));
+            }
+            return;
+        case 24:
+            if (bitFields) {
+                break;
+            }
+            decode(Bgr24Decoder());
+            return;
+        case 32:
+            if (!bitFields || hasMasks(format, 0x00FF0000, 0x0000FF00, 0x000000FF)) {
+                decode(Bgrx32Decoder());
+            } else {
+                decode(MaskedDecoder<4>(format.masks));
+            }
+            return;
+        default:
+            break;
+    }
+    throw std::runtime_error("Unsupported BMP pixel format");
+}
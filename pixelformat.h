@@ -0,0 +1,29 @@
+#ifndef BMPANALYZER_PIXELFORMAT_H
+#define BMPANALYZER_PIXELFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// biCompression values of uncompressed and bit-field images.
+const uint32_t compressionRgb = 0;
+const uint32_t compressionBitFields = 3;
+const uint32_t compressionAlphaBitFields = 6;
+
+// Stored pixel layout of a BMP file, as described by its headers.
+struct PixelFormat {
+    uint16_t bitCount = 24;
+    uint32_t compression = compressionRgb;
+    uint32_t masks[3]{};         // red, green and blue masks of bit-field images
+    std::vector<uint8_t> colors; // BGRX colour table of indexed images
+};
+
+// Decodes height rows of width pixels into the internal 24-bit BGR layout. The
+// format is resolved once per image to a row loop specialised at compile time
+// (indexed 1/4/8-bit, 16-bit 555/565 or arbitrary masks, 32-bit BGRX or
+// arbitrary masks), so no per-pixel branching on the format remains.
+// Throws std::runtime_error for formats it cannot decode.
+void decodeToBgr24(const PixelFormat &format, const uint8_t *source, size_t sourceStride,
+                   uint8_t *destination, size_t destinationStride, size_t width, size_t height);
+
+#endif //BMPANALYZER_PIXELFORMAT_H
@@ -0,0 +1,177 @@
+#include <stdexcept>
+#include "colorconvert.h"
+#include "planarimage.h"
+#include "simd.h"
+#include "threadpool.h"
+
+namespace {
+    size_t alignedStride(int width) {
+        return (static_cast<size_t>(width) + 63) / 64 * 64;
+    }
+
+#ifdef BMP_SSE41
+    // pshufb masks moving 16 interleaved pixels (three 16-byte vectors) to and from
+    // three 16-byte channel vectors.
+    struct ShuffleMasks {
+        __m128i split[3][3]; // [channel][source vector]
+        __m128i merge[3][3]; // [destination vector][channel]
+
+        ShuffleMasks() {
+            for (int channel = 0; channel < 3; ++channel) {
+                for (int vector = 0; vector < 3; ++vector) {
+                    char splitMask[16];
+                    char mergeMask[16];
+                    for (int i = 0; i < 16; ++i) {
+                        int splitPos = 3 * i + channel;
+                        splitMask[i] = static_cast<char>(splitPos / 16 == vector ? splitPos % 16 : -1);
+                        int mergePos = 16 * vector + i;
+                        mergeMask[i] = static_cast<char>(mergePos % 3 == channel ? mergePos / 3 : -1);
+                    }
+                    split[channel][vector] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(splitMask));
+                    merge[vector][channel] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(mergeMask));
+                }
+            }
+        }
+    };
+
+    const ShuffleMasks &shuffleMasks() {
+        static const ShuffleMasks masks;
+        return masks;
+    }
+#endif
+}
+
+void deinterleavePixels(const uint8_t *pixels, uint8_t *c0, uint8_t *c1, uint8_t *c2, size_t count) {
+    size_t i = 0;
+#ifdef BMP_SSE41
+    const ShuffleMasks &masks = shuffleMasks();
+    uint8_t *channels[3] = {c0, c1, c2};
+    for (; i + 16 <= count; i += 16) {
+        __m128i v[3];
+        for (int k = 0; k < 3; ++k) {
+            v[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i * 3 + k * 16));
+        }
+        for (int c = 0; c < 3; ++c) {
+            __m128i channel = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v[0], masks.split[c][0]),
+                                                        _mm_shuffle_epi8(v[1], masks.split[c][1])),
+                                           _mm_shuffle_epi8(v[2], masks.split[c][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(channels[c] + i), channel);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        c0[i] = pixels[i * 3];
+        c1[i] = pixels[i * 3 + 1];
+        c2[i] = pixels[i * 3 + 2];
+    }
+}
+
+void interleavePixels(const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, uint8_t *pixels, size_t count) {
+    size_t i = 0;
+#ifdef BMP_SSE41
+    const ShuffleMasks &masks = shuffleMasks();
+    for (; i + 16 <= count; i += 16) {
+        __m128i channel[3] = {_mm_loadu_si128(reinterpret_cast<const __m128i *>(c0 + i)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i *>(c1 + i)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i *>(c2 + i))};
+        for (int k = 0; k < 3; ++k) {
+            __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(channel[0], masks.merge[k][0]),
+                                                  _mm_shuffle_epi8(channel[1], masks.merge[k][1])),
+                                     _mm_shuffle_epi8(channel[2], masks.merge[k][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i * 3 + k * 16), v);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        pixels[i * 3] = c0[i];
+        pixels[i * 3 + 1] = c1[i];
+        pixels[i * 3 + 2] = c2[i];
+    }
+}
+
+PlanarImage::PlanarImage(int width, int height)
+        : planeWidth(width), planeHeight(height), planeStride(alignedStride(width)) {
+    if (width < 0 || height < 0) {
+        throw std::runtime_error("Invalid image size");
+    }
+    for (auto &plane: planes) {
+        plane.resize(planeStride * height);
+    }
+}
+
+PlanarImage PlanarImage::deinterleave(const uint8_t *pixels, int width, int height, size_t stride) {
+    PlanarImage image(width, height);
+    for (int y = 0; y < height; ++y) {
+        deinterleavePixels(pixels + y * stride, image.row(0, y), image.row(1, y), image.row(2, y), width);
+    }
+    return image;
+}
+
+void PlanarImage::interleave(uint8_t *pixels, size_t stride) const {
+    for (int y = 0; y < planeHeight; ++y) {
+        interleavePixels(row(0, y), row(1, y), row(2, y), pixels + y * stride, planeWidth);
+    }
+}
+
+ChannelStats PlanarImage::countStats() const {
+    StatsAccumulator stats;
+    for (int y = 0; y < planeHeight; ++y) {
+        stats.updatePlanes(row(0, y), row(1, y), row(2, y), planeWidth);
+    }
+    return stats.finalize();
+}
+
+PlanarImage PlanarImage::convertRGBToYCbCr() const {
+    PlanarImage result(planeWidth, planeHeight);
+    parallelRows(planeHeight, planeWidth * 3, [&](size_t first, size_t end) {
+        for (size_t y = first; y < end; ++y) {
+            convertRGBToYCbCrPlanes(row(0, y), row(1, y), row(2, y),
+                                    result.row(0, y), result.row(1, y), result.row(2, y), planeWidth);
+        }
+    });
+    return result;
+}
+
+PlanarImage PlanarImage::convertYCbCrToRGB() const {
+    PlanarImage result(planeWidth, planeHeight);
+    parallelRows(planeHeight, planeWidth * 3, [&](size_t first, size_t end) {
+        for (size_t y = first; y < end; ++y) {
+            convertYCbCrToRGBPlanes(row(0, y), row(1, y), row(2, y),
+                                    result.row(0, y), result.row(1, y), result.row(2, y), planeWidth);
+        }
+    });
+    return result;
+}
+
+PlanarImage PlanarImage::decimateEven(int num) const {
+    if (num <= 0) {
+        throw std::runtime_error("Decimation factor must be positive");
+    }
+    PlanarImage result(planeWidth / num, planeHeight / num);
+    for (int c = 0; c < 3; ++c) {
+        for (int y = 0; y < result.planeHeight; ++y) {
+            const uint8_t *source = row(c, y * num);
+            uint8_t *destination = result.row(c, y);
+            for (int x = 0; x < result.planeWidth; ++x) {
+                destination[x] = source[x * num];
+            }
+        }
+    }
+    return result;
+}
+
+PlanarImage PlanarImage::decimateAvg() const {
+    PlanarImage result(planeWidth / 2, planeHeight / 2);
+    for (int c = 0; c < 3; ++c) {
+        for (int y = 0; y < result.planeHeight; ++y) {
+            const uint8_t *top = row(c, 2 * y);
+            const uint8_t *bottom = row(c, 2 * y + 1);
+            uint8_t *destination = result.row(c, y);
+            for (int x = 0; x < result.planeWidth; ++x) {
+                destination[x] = static_cast<uint8_t>((top[2 * x] + top[2 * x + 1] +
+                                                       bottom[2 * x] + bottom[2 * x + 1]) / 4);
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+#ifndef BMPANALYZER_PLANARIMAGE_H
+#define BMPANALYZER_PLANARIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "aligned.h"
+#include "channelview.h"
+#include "stats.h"
+
+// Three-channel image stored as one plane per channel (structure of arrays).
+// Channel c holds byte c of the interleaved pixels, so the channel indices are
+// the same as for getIndexComponent. Every plane row starts 64-byte aligned.
+class PlanarImage {
+public:
+    PlanarImage() = default;
+
+    PlanarImage(int width, int height);
+
+    // Splits interleaved 3-byte pixels (rows stride bytes apart) into planes.
+    static PlanarImage deinterleave(const uint8_t *pixels, int width, int height, size_t stride);
+
+    // Writes the planes back as interleaved pixels, padding bytes are left untouched.
+    void interleave(uint8_t *pixels, size_t stride) const;
+
+    int width() const {
+        return planeWidth;
+    }
+
+    int height() const {
+        return planeHeight;
+    }
+
+    size_t stride() const {
+        return planeStride;
+    }
+
+    uint8_t *row(int channel, int y) {
+        return planes[channel].data() + y * planeStride;
+    }
+
+    const uint8_t *row(int channel, int y) const {
+        return planes[channel].data() + y * planeStride;
+    }
+
+    ChannelView channel(int channel) const {
+        return {planes[channel].data(), static_cast<size_t>(planeWidth), static_cast<size_t>(planeHeight), 1, planeStride};
+    }
+
+    ChannelStats countStats() const;
+
+    PlanarImage convertRGBToYCbCr() const;
+
+    PlanarImage convertYCbCrToRGB() const;
+
+    PlanarImage decimateEven(int num) const;
+
+    PlanarImage decimateAvg() const;
+
+private:
+    int planeWidth = 0;
+    int planeHeight = 0;
+    size_t planeStride = 0;
+    AlignedVector<uint8_t> planes[3];
+};
+
+// Row kernels behind deinterleave/interleave, usable on any buffers.
+void deinterleavePixels(const uint8_t *pixels, uint8_t *c0, uint8_t *c1, uint8_t *c2, size_t count);
+
+void interleavePixels(const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, uint8_t *pixels, size_t count);
+
+#endif //BMPANALYZER_PLANARIMAGE_H
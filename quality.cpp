@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include "bmp.h"
+#include "quality.h"
+#include "simd.h"
+#include "threadpool.h"
+
+namespace {
+    // Squared differences of interleaved bytes. A block of 48 bytes (16 pixels)
+    // keeps every byte position on the same channel, so each 32-bit lane only
+    // ever collects one channel; lanes are moved to 64 bits before they can overflow.
+    void sumSquaredErrors(const uint8_t *pixels1, const uint8_t *pixels2, size_t pixelCount,
+                          uint64_t (&sums)[3]) {
+        size_t bytes = pixelCount * 3;
+        size_t i = 0;
+#ifdef BMP_SSE41
+        // a block adds at most 255^2 to a lane
+        const size_t blocksPerFlush = 32768;
+#ifdef BMP_AVX2
+        // lane l of accumulator 2k + p holds byte 16k + 2l + p
+        using Lanes = __m256i;
+        const int accumulatorCount = 6;
+        auto lanePosition = [](int accumulator, int lane) {
+            return 16 * (accumulator / 2) + 2 * lane + accumulator % 2;
+        };
+#else
+        // lane l of accumulator 4k + 2h + p holds byte 16k + 8h + 2l + p
+        using Lanes = __m128i;
+        const int accumulatorCount = 12;
+        auto lanePosition = [](int accumulator, int lane) {
+            return 16 * (accumulator / 4) + 8 * (accumulator / 2 % 2) + 2 * lane + accumulator % 2;
+        };
+#endif
+        while (i + 48 <= bytes) {
+            size_t blocks = std::min((bytes - i) / 48, blocksPerFlush);
+            Lanes lanes[accumulatorCount];
+            std::memset(lanes, 0, sizeof(lanes));
+
+            for (size_t block = 0; block < blocks; ++block, i += 48) {
+                for (int k = 0; k < 3; ++k) {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels1 + i + k * 16));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels2 + i + k * 16));
+#ifdef BMP_AVX2
+                    __m256i difference = _mm256_sub_epi16(_mm256_cvtepu8_epi16(a), _mm256_cvtepu8_epi16(b));
+                    // the square fits 16 bits when read as unsigned
+                    __m256i square = _mm256_mullo_epi16(difference, difference);
+                    lanes[2 * k] = _mm256_add_epi32(lanes[2 * k], _mm256_and_si256(square, _mm256_set1_epi32(0xFFFF)));
+                    lanes[2 * k + 1] = _mm256_add_epi32(lanes[2 * k + 1], _mm256_srli_epi32(square, 16));
+#else
+                    // low and high eight bytes widened to 16 bits
+                    __m128i wideA[2] = {_mm_cvtepu8_epi16(a), _mm_cvtepu8_epi16(_mm_srli_si128(a, 8))};
+                    __m128i wideB[2] = {_mm_cvtepu8_epi16(b), _mm_cvtepu8_epi16(_mm_srli_si128(b, 8))};
+                    for (int h = 0; h < 2; ++h) {
+                        __m128i difference = _mm_sub_epi16(wideA[h], wideB[h]);
+                        __m128i square = _mm_mullo_epi16(difference, difference);
+                        Lanes &even = lanes[4 * k + 2 * h];
+                        Lanes &odd = lanes[4 * k + 2 * h + 1];
+                        even = _mm_add_epi32(even, _mm_and_si128(square, _mm_set1_epi32(0xFFFF)));
+                        odd = _mm_add_epi32(odd, _mm_srli_epi32(square, 16));
+                    }
+#endif
+                }
+            }
+            for (int accumulator = 0; accumulator < accumulatorCount; ++accumulator) {
+                uint32_t values[sizeof(Lanes) / 4];
+                std::memcpy(values, &lanes[accumulator], sizeof(values));
+                for (int lane = 0; lane < static_cast<int>(sizeof(Lanes) / 4); ++lane) {
+                    sums[lanePosition(accumulator, lane) % 3] += values[lane];
+                }
+            }
+        }
+#endif
+        for (; i < bytes; ++i) {
+            int difference = pixels1[i] - pixels2[i];
+            sums[i % 3] += static_cast<uint64_t>(difference * difference);
+        }
+    }
+
+    double psnrFromSums(uint64_t sumSquares, uint64_t count) {
+        if (sumSquares == 0) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return 10 * std::log10(static_cast<double>(count) * 255.0 * 255.0 / static_cast<double>(sumSquares));
+    }
+}
+
+double ErrorStats::mseOf(char component) const {
+    return mse[getIndexComponent(component)];
+}
+
+double ErrorStats::psnrOf(char component) const {
+    return psnr[getIndexComponent(component)];
+}
+
+void ErrorAccumulator::update(const uint8_t *pixels1, const uint8_t *pixels2, size_t pixelCount) {
+    sumSquaredErrors(pixels1, pixels2, pixelCount, sumSquares);
+    count += pixelCount;
+}
+
+void ErrorAccumulator::update(const ImageView &image1, const ImageView &image2) {
+    if (image1.width != image2.width || image1.height != image2.height) {
+        throw std::runtime_error("Images differ in size");
+    }
+    if (image1.contiguous() && image2.contiguous()) {
+        update(image1.data, image2.data, image1.count());
+        return;
+    }
+    for (size_t y = 0; y < image1.height; ++y) {
+        update(image1.row(y), image2.row(y), image1.width);
+    }
+}
+
+void ErrorAccumulator::merge(const ErrorAccumulator &other) {
+    count += other.count;
+    for (int c = 0; c < 3; ++c) {
+        sumSquares[c] += other.sumSquares[c];
+    }
+}
+
+ErrorStats ErrorAccumulator::finalize() const {
+    ErrorStats stats;
+    stats.count = count;
+    if (count == 0) {
+        return stats;
+    }
+    uint64_t total = 0;
+    for (int c = 0; c < 3; ++c) {
+        stats.mse[c] = static_cast<double>(sumSquares[c]) / static_cast<double>(count);
+        stats.psnr[c] = psnrFromSums(sumSquares[c], count);
+        total += sumSquares[c];
+    }
+    stats.totalMse = static_cast<double>(total) / static_cast<double>(count * 3);
+    stats.totalPsnr = psnrFromSums(total, count * 3);
+    return stats;
+}
+
+ErrorStats countErrors(const ImageView &image1, const ImageView &image2) {
+    if (image1.width != image2.width || image1.height != image2.height) {
+        throw std::runtime_error("Images differ in size");
+    }
+    return reduceRows<ErrorAccumulator>(
+            image1.height, image1.width * 6,
+            [&](size_t first, size_t end) {
+                ErrorAccumulator band;
+                band.update(image1.rows(first, end), image2.rows(first, end));
+                return band;
+            },
+            [](ErrorAccumulator &total, const ErrorAccumulator &band) { total.merge(band); }).finalize();
+}
+
+namespace {
+    // SSIM constants for 8-bit samples, (0.01 * 255)^2 and (0.03 * 255)^2.
+    const double ssimC1 = 6.5025;
+    const double ssimC2 = 58.5225;
+
+    // Sums over the windows of a band: of the SSIM values and of the contrast-structure
+    // term alone, which is what MS-SSIM uses at every scale but the last.
+    struct SsimSums {
+        double ssim = 0;
+        double contrastStructure = 0;
+        uint64_t count = 0;
+
+        void merge(const SsimSums &other) {
+            ssim += other.ssim;
+            contrastStructure += other.contrastStructure;
+            count += other.count;
+        }
+    };
+
+    void gatherRow(const ChannelView &view, size_t y, uint32_t *out) {
+        const uint8_t *in = view.data + y * view.rowStride;
+        for (size_t x = 0; x < view.width; ++x) {
+            out[x] = in[x * view.step];
+        }
+    }
+
+    // Windows whose top row is in [first, end). Per column the five sums (x, y,
+    // x^2, y^2, xy) of the window rows are kept and moved down a row at a time;
+    // along the row the window sums are differences of their prefix sums.
+    struct SsimTerms {
+        double ssim;
+        double contrastStructure;
+    };
+
+    // SSIM and contrast-structure terms of one window from its n-scaled sums,
+    // in the operation order of the AVX2 lanes so every build rounds alike.
+    SsimTerms ssimTerms(double mx, double my, double mxx, double myy, double mxy, double n, double c1, double c2) {
+        double meanProduct = mx * my;
+        double meanSquares = mx * mx + my * my;
+        double covariance = n * mxy - meanProduct;
+        double variances = n * (mxx + myy) - meanSquares;
+        double luminanceBottom = meanSquares + c1;
+        // one division for both terms
+        double structure = (2 * covariance + c2) * (1 / (luminanceBottom * (variances + c2)));
+        return {(2 * meanProduct + c1) * structure, luminanceBottom * structure};
+    }
+
+    SsimSums ssimBand(const ChannelView &image1, const ChannelView &image2, size_t window, size_t first, size_t end) {
+        size_t width = image1.width;
+        size_t positions = width - window + 1;
+        std::vector<uint32_t> columns(5 * width, 0);
+        std::vector<uint32_t> windowSums(5 * positions);
+        std::vector<uint32_t> row1(width);
+        std::vector<uint32_t> row2(width);
+
+        uint32_t *sx = columns.data();
+        uint32_t *sy = sx + width;
+        uint32_t *sxx = sy + width;
+        uint32_t *syy = sxx + width;
+        uint32_t *sxy = syy + width;
+        auto addRow = [&](size_t y, bool add) {
+            gatherRow(image1, y, row1.data());
+            gatherRow(image2, y, row2.data());
+            // unsigned wrap-around makes subtraction exact as well
+            uint32_t sign = add ? 1 : static_cast<uint32_t>(-1);
+            for (size_t x = 0; x < width; ++x) {
+                uint32_t a = row1[x];
+                uint32_t b = row2[x];
+                sx[x] += sign * a;
+                sy[x] += sign * b;
+                sxx[x] += sign * a * a;
+                syy[x] += sign * b * b;
+                sxy[x] += sign * a * b;
+            }
+        };
+
+        for (size_t y = first; y < first + window; ++y) {
+            addRow(y, true);
+        }
+
+        auto n = static_cast<double>(window * window);
+        double c1 = ssimC1 * n * n;
+        double c2 = ssimC2 * n * n;
+        SsimSums sums;
+        for (size_t y = first; y < end; ++y) {
+            if (y > first) {
+                addRow(y - 1, false);
+                addRow(y + window - 1, true);
+            }
+            // the window sums along the row add up window shifted copies of the column sums
+            std::fill(windowSums.begin(), windowSums.end(), 0);
+            for (int t = 0; t < 5; ++t) {
+                const uint32_t *column = columns.data() + t * width;
+                uint32_t *out = windowSums.data() + t * positions;
+                for (size_t k = 0; k < window; ++k) {
+                    for (size_t x = 0; x < positions; ++x) {
+                        out[x] += column[x + k];
+                    }
+                }
+            }
+
+            // with the sums scaled by n, every term of the SSIM formula carries a factor n^2 that cancels
+            const uint32_t *wx = windowSums.data();
+            const uint32_t *wy = wx + positions;
+            const uint32_t *wxx = wy + positions;
+            const uint32_t *wyy = wxx + positions;
+            const uint32_t *wxy = wyy + positions;
+            // four interleaved lanes, summed in a fixed order, then the positions left over
+            double ssimLanes[4]{};
+            double contrastStructureLanes[4]{};
+            size_t x = 0;
+#ifdef BMP_AVX2
+            const __m256d vn = _mm256_set1_pd(n);
+            const __m256d vc1 = _mm256_set1_pd(c1);
+            const __m256d vc2 = _mm256_set1_pd(c2);
+            const __m256d two = _mm256_set1_pd(2);
+            __m256d ssimSum = _mm256_setzero_pd();
+            __m256d contrastStructureSum = _mm256_setzero_pd();
+            // the sums stay below 2^31 for windows up to 128, so the signed conversion is exact
+            auto load = [](const uint32_t *p) {
+                return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+            };
+            // no FMA: the scalar build would round differently
+            for (; x + 4 <= positions; x += 4) {
+                __m256d mx = load(wx + x);
+                __m256d my = load(wy + x);
+                __m256d meanProduct = _mm256_mul_pd(mx, my);
+                __m256d meanSquares = _mm256_add_pd(_mm256_mul_pd(mx, mx), _mm256_mul_pd(my, my));
+                __m256d covariance = _mm256_sub_pd(_mm256_mul_pd(vn, load(wxy + x)), meanProduct);
+                __m256d variances = _mm256_sub_pd(_mm256_mul_pd(vn, _mm256_add_pd(load(wxx + x), load(wyy + x))),
+                                                  meanSquares);
+                __m256d luminanceTop = _mm256_add_pd(_mm256_mul_pd(two, meanProduct), vc1);
+                __m256d luminanceBottom = _mm256_add_pd(meanSquares, vc1);
+                __m256d structureTop = _mm256_add_pd(_mm256_mul_pd(two, covariance), vc2);
+                __m256d structureBottom = _mm256_add_pd(variances, vc2);
+                __m256d inverse = _mm256_div_pd(_mm256_set1_pd(1), _mm256_mul_pd(luminanceBottom, structureBottom));
+                __m256d structure = _mm256_mul_pd(structureTop, inverse);
+                ssimSum = _mm256_add_pd(ssimSum, _mm256_mul_pd(luminanceTop, structure));
+                contrastStructureSum = _mm256_add_pd(contrastStructureSum, _mm256_mul_pd(luminanceBottom, structure));
+            }
+            _mm256_storeu_pd(ssimLanes, ssimSum);
+            _mm256_storeu_pd(contrastStructureLanes, contrastStructureSum);
+#else
+            for (; x + 4 <= positions; x += 4) {
+                for (size_t lane = 0; lane < 4; ++lane) {
+                    size_t i = x + lane;
+                    SsimTerms terms = ssimTerms(wx[i], wy[i], wxx[i], wyy[i], wxy[i], n, c1, c2);
+                    ssimLanes[lane] += terms.ssim;
+                    contrastStructureLanes[lane] += terms.contrastStructure;
+                }
+            }
+#endif
+            double rowSsim = (ssimLanes[0] + ssimLanes[1]) + (ssimLanes[2] + ssimLanes[3]);
+            double rowContrastStructure = (contrastStructureLanes[0] + contrastStructureLanes[1]) +
+                                          (contrastStructureLanes[2] + contrastStructureLanes[3]);
+            for (; x < positions; ++x) {
+                SsimTerms terms = ssimTerms(wx[x], wy[x], wxx[x], wyy[x], wxy[x], n, c1, c2);
+                rowSsim += terms.ssim;
+                rowContrastStructure += terms.contrastStructure;
+            }
+            sums.ssim += rowSsim;
+            sums.contrastStructure += rowContrastStructure;
+            sums.count += positions;
+        }
+        return sums;
+    }
+
+    SsimSums ssimSums(const ChannelView &image1, const ChannelView &image2, int windowSize) {
+        if (image1.width != image2.width || image1.height != image2.height) {
+            throw std::runtime_error("Images differ in size");
+        }
+        auto window = static_cast<size_t>(windowSize);
+        if (windowSize <= 0 || windowSize > 128 || image1.width < window || image1.height < window) {
+            throw std::runtime_error("SSIM window does not fit the image");
+        }
+        return reduceRows<SsimSums>(
+                image1.height - window + 1, image1.width * 2,
+                [&](size_t first, size_t end) { return ssimBand(image1, image2, window, first, end); },
+                [](SsimSums &total, const SsimSums &band) { total.merge(band); });
+    }
+
+    // 2x2 average with rounding; an odd last row or column is dropped.
+    std::vector<uint8_t> halve(const ChannelView &view, ChannelView &result) {
+        size_t width = view.width / 2;
+        size_t height = view.height / 2;
+        std::vector<uint8_t> data(width * height);
+        parallelRows(height, width, [&](size_t first, size_t end) {
+            for (size_t y = first; y < end; ++y) {
+                const uint8_t *top = view.data + 2 * y * view.rowStride;
+                const uint8_t *bottom = top + view.rowStride;
+                uint8_t *out = data.data() + y * width;
+                for (size_t x = 0; x < width; ++x) {
+                    size_t left = 2 * x * view.step;
+                    size_t right = left + view.step;
+                    out[x] = static_cast<uint8_t>((top[left] + top[right] + bottom[left] + bottom[right] + 2) / 4);
+                }
+            }
+        });
+        result = {data.data(), width, height, 1, width};
+        return data;
+    }
+}
+
+double countSSIM(const ChannelView &image1, const ChannelView &image2, int windowSize) {
+    SsimSums sums = ssimSums(image1, image2, windowSize);
+    return sums.ssim / static_cast<double>(sums.count);
+}
+
+double countMSSSIM(const ChannelView &image1, const ChannelView &image2, int windowSize) {
+    const double weights[5] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+    if (image1.width != image2.width || image1.height != image2.height) {
+        throw std::runtime_error("Images differ in size");
+    }
+    if (windowSize <= 0 || std::min(image1.width, image1.height) >> 4 < static_cast<size_t>(windowSize)) {
+        throw std::runtime_error("Image too small for MS-SSIM");
+    }
+
+    ChannelView scaled1 = image1;
+    ChannelView scaled2 = image2;
+    std::vector<uint8_t> data1;
+    std::vector<uint8_t> data2;
+    double result = 1;
+    for (int scale = 0; scale < 5; ++scale) {
+        if (scale > 0) {
+            data1 = halve(ChannelView(scaled1), scaled1);
+            data2 = halve(ChannelView(scaled2), scaled2);
+        }
+        SsimSums sums = ssimSums(scaled1, scaled2, windowSize);
+        auto count = static_cast<double>(sums.count);
+        // negative means (anti-correlated structure) count as zero similarity
+        double value = std::max(0.0, (scale < 4 ? sums.contrastStructure : sums.ssim) / count);
+        result *= std::pow(value, weights[scale]);
+    }
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef BMPANALYZER_QUALITY_H
+#define BMPANALYZER_QUALITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include "channelview.h"
+#include "imageview.h"
+
+// Mean squared error and PSNR (peak 255) between two images, per channel
+// indexed as in getIndexComponent and over all channels together. PSNR is
+// +infinity where the images are identical.
+struct ErrorStats {
+    uint64_t count = 0;
+    double mse[3]{};
+    double psnr[3]{};
+    double totalMse = 0;
+    double totalPsnr = 0;
+
+    double mseOf(char component) const;
+
+    double psnrOf(char component) const;
+};
+
+// Exact per-channel sums of squared differences, mergeable across bands and threads.
+struct ErrorAccumulator {
+    uint64_t count = 0;
+    uint64_t sumSquares[3]{};
+
+    // Adds pixelCount interleaved 3-byte pixels of both images.
+    void update(const uint8_t *pixels1, const uint8_t *pixels2, size_t pixelCount);
+
+    void update(const ImageView &image1, const ImageView &image2);
+
+    void merge(const ErrorAccumulator &other);
+
+    ErrorStats finalize() const;
+};
+
+// All channels in a single band-parallel pass; the views must have the same size.
+ErrorStats countErrors(const ImageView &image1, const ImageView &image2);
+
+// Mean SSIM of two channels of the same size (an interleaved channel or a
+// plane such as Y) over every windowSize x windowSize box window. Window sums
+// come from rolling column sums, bands of windows are computed in parallel.
+double countSSIM(const ChannelView &image1, const ChannelView &image2, int windowSize = 8);
+
+// Multi-scale SSIM over five scales with the weights of Wang et al. (2003),
+// halving both images with a 2x2 average between scales. The smallest scale
+// must still hold one window.
+double countMSSSIM(const ChannelView &image1, const ChannelView &image2, int windowSize = 8);
+
+#endif //BMPANALYZER_QUALITY_H
@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "divider.h"
+#include "planarimage.h"
+#include "resample.h"
+#include "simd.h"
+#include "threadpool.h"
+
+namespace {
+    // Adds the sums of count blocks of blockWidth values to sums. Pairs of
+    // bytes summed into 16-bit lanes (2x2, 2x1) take maddubs with ones.
+    template<typename In, typename Sum>
+    void addBlocks(const In *in, Sum *sums, size_t count, size_t blockWidth) {
+        size_t x = 0;
+        if (blockWidth == 1) {
+            for (; x < count; ++x) {
+                sums[x] += in[x];
+            }
+            return;
+        }
+        if (blockWidth == 2) {
+            if constexpr (std::is_same_v<In, uint8_t> && std::is_same_v<Sum, uint16_t>) {
+#ifdef BMP_AVX2
+                const __m256i ones = _mm256_set1_epi8(1);
+                for (; x + 16 <= count; x += 16) {
+                    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 2 * x));
+                    __m256i pairs = _mm256_maddubs_epi16(bytes, ones);
+                    auto *out = reinterpret_cast<__m256i *>(sums + x);
+                    _mm256_storeu_si256(out, _mm256_add_epi16(_mm256_loadu_si256(out), pairs));
+                }
+#elif defined(BMP_SSE41)
+                const __m128i ones = _mm_set1_epi8(1);
+                for (; x + 8 <= count; x += 8) {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * x));
+                    __m128i pairs = _mm_maddubs_epi16(bytes, ones);
+                    auto *out = reinterpret_cast<__m128i *>(sums + x);
+                    _mm_storeu_si128(out, _mm_add_epi16(_mm_loadu_si128(out), pairs));
+                }
+#endif
+            }
+            for (; x < count; ++x) {
+                sums[x] += in[2 * x] + in[2 * x + 1];
+            }
+            return;
+        }
+        // common widths get a fixed inner loop the compiler can unroll
+        auto addFixed = [&](auto width) {
+            for (; x < count; ++x) {
+                Sum sum = 0;
+                for (size_t k = 0; k < width; ++k) {
+                    sum += in[x * width + k];
+                }
+                sums[x] += sum;
+            }
+        };
+        switch (blockWidth) {
+            case 3:
+                addFixed(std::integral_constant<size_t, 3>());
+                break;
+            case 4:
+                addFixed(std::integral_constant<size_t, 4>());
+                break;
+            default:
+                addFixed(blockWidth);
+        }
+    }
+
+    // Rounded sums / divisor; power-of-two block sizes reduce to a shift.
+    template<typename Sum>
+    void divideBlocks(const Sum *sums, uint8_t *out, size_t count, uint32_t divisor) {
+        if ((divisor & (divisor - 1)) == 0) {
+            int shift = 0;
+            while ((1u << shift) < divisor) {
+                ++shift;
+            }
+            uint32_t half = divisor / 2;
+            for (size_t x = 0; x < count; ++x) {
+                out[x] = static_cast<uint8_t>((sums[x] + half) >> shift);
+            }
+            return;
+        }
+        RoundedDivider divider(divisor);
+        for (size_t x = 0; x < count; ++x) {
+            out[x] = divider(sums[x]);
+        }
+    }
+
+    // Every destination row: the block rows are split into planes and summed,
+    // then divided and interleaved again. Blocks up to two pixels wide are
+    // summed across straight from the bytes of each row; wider blocks sum the
+    // columns down the rows first, so each block is reduced across only once.
+    template<typename Sum>
+    void decimateRows(const ImageView &source, const MutableImageView &destination,
+                      size_t blockWidth, size_t blockHeight) {
+        size_t width = destination.width;
+        size_t usedWidth = width * blockWidth;
+        parallelRows(destination.height, usedWidth * 3 * blockHeight, [&](size_t first, size_t end) {
+            std::vector<uint8_t> planes[3] = {std::vector<uint8_t>(usedWidth), std::vector<uint8_t>(usedWidth),
+                                              std::vector<uint8_t>(usedWidth)};
+            std::vector<Sum> sums[3] = {std::vector<Sum>(width), std::vector<Sum>(width), std::vector<Sum>(width)};
+            bool fromBytes = blockWidth <= 2;
+            size_t columnCount = fromBytes ? 0 : usedWidth;
+            std::vector<Sum> columns[3] = {std::vector<Sum>(columnCount), std::vector<Sum>(columnCount),
+                                           std::vector<Sum>(columnCount)};
+            std::vector<uint8_t> means[3] = {std::vector<uint8_t>(width), std::vector<uint8_t>(width),
+                                             std::vector<uint8_t>(width)};
+            auto divisor = static_cast<uint32_t>(blockWidth * blockHeight);
+
+            for (size_t y = first; y < end; ++y) {
+                for (int c = 0; c < 3; ++c) {
+                    std::fill(sums[c].begin(), sums[c].end(), 0);
+                    std::fill(columns[c].begin(), columns[c].end(), 0);
+                }
+                for (size_t k = 0; k < blockHeight; ++k) {
+                    deinterleavePixels(source.row(y * blockHeight + k), planes[0].data(), planes[1].data(),
+                                       planes[2].data(), usedWidth);
+                    for (int c = 0; c < 3; ++c) {
+                        if (fromBytes) {
+                            addBlocks(planes[c].data(), sums[c].data(), width, blockWidth);
+                        } else {
+                            addBlocks(planes[c].data(), columns[c].data(), usedWidth, 1);
+                        }
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    if (!fromBytes) {
+                        addBlocks(columns[c].data(), sums[c].data(), width, blockWidth);
+                    }
+                    divideBlocks(sums[c].data(), means[c].data(), width, divisor);
+                }
+                interleavePixels(means[0].data(), means[1].data(), means[2].data(), destination.row(y), width);
+            }
+        });
+    }
+
+    // Fixed-point precision of the resampling taps: int16 holds taps in
+    // [-2, 32767 / 16384], just short of 2.0.
+    const int weightBits = 14;
+
+    // Fixed-point tap clamped to int16. Normalised taps of these filters stay
+    // within about [-0.3, 1.3]; the clamp only keeps a stray one from wrapping.
+    int16_t toTap(long value) {
+        return static_cast<int16_t>(std::clamp<long>(value, INT16_MIN, INT16_MAX));
+    }
+
+    double filterSupport(ResampleFilter filter) {
+        switch (filter) {
+            case ResampleFilter::Bilinear:
+                return 1;
+            case ResampleFilter::Bicubic:
+                return 2;
+            default:
+                return 3;
+        }
+    }
+
+    const double pi = 3.14159265358979323846;
+
+    double sinc(double x) {
+        if (x == 0) {
+            return 1;
+        }
+        x *= pi;
+        return std::sin(x) / x;
+    }
+
+    double filterWeight(ResampleFilter filter, double x) {
+        x = std::fabs(x);
+        switch (filter) {
+            case ResampleFilter::Bilinear:
+                return x < 1 ? 1 - x : 0;
+            case ResampleFilter::Bicubic: {
+                const double a = -0.5;
+                if (x < 1) {
+                    return ((a + 2) * x - (a + 3)) * x * x + 1;
+                }
+                return x < 2 ? ((a * x - 5 * a) * x + 8 * a) * x - 4 * a : 0;
+            }
+            default:
+                return x < 3 ? sinc(x) * sinc(x / 3) : 0;
+        }
+    }
+
+    // Taps of every destination index along one axis: the first source index
+    // and an even number of weights summing to 1 << weightBits. Sets shorter
+    // than the longest end in zero weights, which may reach past the source.
+    struct FilterTaps {
+        size_t taps = 0;
+        std::vector<size_t> first;
+        std::vector<int16_t> weights;
+
+        FilterTaps(ResampleFilter filter, size_t sourceSize, size_t destinationSize) : first(destinationSize) {
+            double scale = static_cast<double>(sourceSize) / static_cast<double>(destinationSize);
+            double filterScale = std::max(scale, 1.0);
+            double support = filterSupport(filter) * filterScale;
+
+            std::vector<std::vector<int16_t>> sets(destinationSize);
+            for (size_t i = 0; i < destinationSize; ++i) {
+                double centre = (static_cast<double>(i) + 0.5) * scale;
+                auto begin = static_cast<size_t>(std::max(0.0, std::floor(centre - support + 0.5)));
+                auto end = std::min(sourceSize, static_cast<size_t>(std::max(0.0, std::floor(centre + support + 0.5))));
+                end = std::max(end, begin + 1);
+
+                std::vector<double> exact(end - begin);
+                double total = 0;
+                for (size_t k = 0; k < exact.size(); ++k) {
+                    exact[k] = filterWeight(filter, (static_cast<double>(begin + k) + 0.5 - centre) / filterScale);
+                    total += exact[k];
+                }
+                // rounding errors go to the largest tap so flat areas stay exact
+                std::vector<int16_t> &set = sets[i];
+                int sum = 0;
+                size_t largest = 0;
+                for (size_t k = 0; k < exact.size(); ++k) {
+                    set.push_back(toTap(std::lround(exact[k] / total * (1 << weightBits))));
+                    sum += set[k];
+                    largest = set[k] > set[largest] ? k : largest;
+                }
+                set[largest] = toTap(set[largest] + (1 << weightBits) - sum);
+
+                // zero taps at the ends (where the filter only touches) are dropped
+                size_t skip = 0;
+                while (set[skip] == 0) {
+                    ++skip;
+                }
+                while (set.back() == 0) {
+                    set.pop_back();
+                }
+                set.erase(set.begin(), set.begin() + static_cast<ptrdiff_t>(skip));
+                first[i] = begin + skip;
+                taps = std::max(taps, set.size());
+            }
+
+            taps += taps % 2;
+            weights.assign(destinationSize * taps, 0);
+            for (size_t i = 0; i < destinationSize; ++i) {
+                std::copy(sets[i].begin(), sets[i].end(), weights.begin() + static_cast<ptrdiff_t>(i * taps));
+            }
+        }
+
+        // Tap k and k + 1 of index i as one 32-bit lane for madd_epi16.
+        uint32_t pair(size_t i, size_t k) const {
+            const int16_t *w = weights.data() + i * taps + k;
+            return static_cast<uint16_t>(w[0]) | static_cast<uint32_t>(static_cast<uint16_t>(w[1])) << 16;
+        }
+    };
+
+    uint8_t clampWeighted(int32_t sum) {
+        return static_cast<uint8_t>(std::clamp(sum >> weightBits, 0, 255));
+    }
+
+    // One row through the horizontal taps. in holds the source row followed
+    // by zero padding for the taps past its end and for 8-byte loads.
+    void resampleRow(const uint8_t *in, uint8_t *out, size_t width, const FilterTaps &taps) {
+        for (size_t x = 0; x < width; ++x) {
+            const uint8_t *pixel = in + taps.first[x] * 3;
+#ifdef BMP_SSE41
+            // two source pixels per step: bytes widened to (c of pixel k, c of pixel k + 1)
+            // pairs, one madd with the two taps gives the three channel sums
+            const __m128i pairMask = _mm_setr_epi8(0, -1, 3, -1, 1, -1, 4, -1, 2, -1, 5, -1, -1, -1, -1, -1);
+            __m128i sum = _mm_set1_epi32(1 << (weightBits - 1));
+            for (size_t k = 0; k < taps.taps; k += 2) {
+                __m128i pixels = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(pixel + 3 * k));
+                __m128i pairs = _mm_shuffle_epi8(pixels, pairMask);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, _mm_set1_epi32(static_cast<int>(taps.pair(x, k)))));
+            }
+            sum = _mm_srai_epi32(sum, weightBits);
+            __m128i words = _mm_packs_epi32(sum, sum);
+            sum = _mm_packus_epi16(words, words);
+            auto bytes = static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+            // the fourth byte is overwritten by the next pixel
+            std::memcpy(out + 3 * x, &bytes, x + 1 < width ? 4 : 3);
+#else
+            const int16_t *weights = taps.weights.data() + x * taps.taps;
+            int32_t sums[3] = {1 << (weightBits - 1), 1 << (weightBits - 1), 1 << (weightBits - 1)};
+            for (size_t k = 0; k < taps.taps; ++k) {
+                for (int c = 0; c < 3; ++c) {
+                    sums[c] += weights[k] * pixel[3 * k + c];
+                }
+            }
+            for (int c = 0; c < 3; ++c) {
+                out[3 * x + c] = clampWeighted(sums[c]);
+            }
+#endif
+        }
+    }
+
+    // Weighted sum of the rows for one destination row; taps is even. Bytes of
+    // two rows are interleaved into 16-bit pairs and summed with madd.
+    void resampleColumns(const uint8_t *const *rows, const FilterTaps &taps, size_t y, uint8_t *out, size_t count) {
+        const int16_t *weights = taps.weights.data() + y * taps.taps;
+        size_t i = 0;
+#ifdef BMP_AVX2
+        for (; i + 16 <= count; i += 16) {
+            __m256i low = _mm256_set1_epi32(1 << (weightBits - 1));
+            __m256i high = low;
+            for (size_t k = 0; k < taps.taps; k += 2) {
+                __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + i)));
+                __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k + 1] + i)));
+                __m256i pair = _mm256_set1_epi32(static_cast<int>(taps.pair(y, k)));
+                low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pair));
+                high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pair));
+            }
+            // the unpacks work within 128-bit lanes, so the packs restore the order
+            __m256i words = _mm256_packs_epi32(_mm256_srai_epi32(low, weightBits), _mm256_srai_epi32(high, weightBits));
+            __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_castsi256_si128(bytes));
+        }
+#elif defined(BMP_SSE41)
+        for (; i + 8 <= count; i += 8) {
+            __m128i low = _mm_set1_epi32(1 << (weightBits - 1));
+            __m128i high = low;
+            for (size_t k = 0; k < taps.taps; k += 2) {
+                __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[k] + i)));
+                __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[k + 1] + i)));
+                __m128i pair = _mm_set1_epi32(static_cast<int>(taps.pair(y, k)));
+                low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pair));
+                high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pair));
+            }
+            __m128i words = _mm_packs_epi32(_mm_srai_epi32(low, weightBits), _mm_srai_epi32(high, weightBits));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(words, words));
+        }
+#endif
+        for (; i < count; ++i) {
+            int32_t sum = 1 << (weightBits - 1);
+            for (size_t k = 0; k < taps.taps; ++k) {
+                sum += weights[k] * rows[k][i];
+            }
+            out[i] = clampWeighted(sum);
+        }
+    }
+}
+
+const char *resampleFilterName(ResampleFilter filter) {
+    switch (filter) {
+        case ResampleFilter::Bilinear:
+            return "Bilinear";
+        case ResampleFilter::Bicubic:
+            return "Bicubic";
+        default:
+            return "Lanczos3";
+    }
+}
+
+void decimateBox(const ImageView &source, const MutableImageView &destination, int horizontal, int vertical) {
+    if (horizontal <= 0 || vertical <= 0 || horizontal * vertical > 65535) {
+        throw std::runtime_error("Invalid decimation factors");
+    }
+    auto blockWidth = static_cast<size_t>(horizontal);
+    auto blockHeight = static_cast<size_t>(vertical);
+    if (destination.width != source.width / blockWidth || destination.height != source.height / blockHeight) {
+        throw std::runtime_error("Image size does not match");
+    }
+    if (destination.width == 0 || destination.height == 0) {
+        return;
+    }
+    // block sums up to 255 * 257 still fit 16-bit lanes
+    if (blockWidth * blockHeight <= 257) {
+        decimateRows<uint16_t>(source, destination, blockWidth, blockHeight);
+    } else {
+        decimateRows<uint32_t>(source, destination, blockWidth, blockHeight);
+    }
+}
+
+void resample(const ImageView &source, const MutableImageView &destination, ResampleFilter filter) {
+    if (destination.width == 0 || destination.height == 0) {
+        return;
+    }
+    if (source.width == 0 || source.height == 0) {
+        throw std::runtime_error("Cannot resample an empty image");
+    }
+    size_t rowBytes = destination.width * 3;
+
+    // Horizontal pass over the source rows, straight into the destination when
+    // the height stays, else into an intermediate image for the vertical pass.
+    ImageView columns = source;
+    std::vector<uint8_t> intermediate;
+    if (destination.width != source.width) {
+        FilterTaps taps(filter, source.width, destination.width);
+        MutableImageView target = destination;
+        if (destination.height != source.height) {
+            intermediate.resize(rowBytes * source.height);
+            target = MutableImageView(intermediate.data(), destination.width, source.height, rowBytes);
+        }
+        parallelRows(source.height, rowBytes * taps.taps, [&](size_t first, size_t end) {
+            std::vector<uint8_t> padded((source.width + taps.taps) * 3 + 8, 0);
+            for (size_t y = first; y < end; ++y) {
+                std::memcpy(padded.data(), source.row(y), source.width * 3);
+                resampleRow(padded.data(), target.row(y), destination.width, taps);
+            }
+        });
+        if (destination.height == source.height) {
+            return;
+        }
+        columns = target;
+    }
+
+    if (destination.height == source.height) {
+        parallelRows(destination.height, rowBytes, [&](size_t first, size_t end) {
+            for (size_t y = first; y < end; ++y) {
+                std::memcpy(destination.row(y), columns.row(y), rowBytes);
+            }
+        });
+        return;
+    }
+    FilterTaps taps(filter, source.height, destination.height);
+    parallelRows(destination.height, rowBytes * taps.taps, [&](size_t first, size_t end) {
+        // rows past the bottom only ever meet zero taps
+        std::vector<const uint8_t *> rows(taps.taps);
+        for (size_t y = first; y < end; ++y) {
+            for (size_t k = 0; k < taps.taps; ++k) {
+                rows[k] = columns.row(std::min(taps.first[y] + k, source.height - 1));
+            }
+            resampleColumns(rows.data(), taps, y, destination.row(y), rowBytes);
+        }
+    });
+}
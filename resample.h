@@ -0,0 +1,27 @@
+#ifndef BMPANALYZER_RESAMPLE_H
+#define BMPANALYZER_RESAMPLE_H
+
+#include "imageview.h"
+
+enum class ResampleFilter {
+    Bilinear, // triangle, one source pixel either side
+    Bicubic,  // Keys cubic (a = -0.5), two pixels either side
+    Lanczos3  // windowed sinc, three pixels either side
+};
+
+const char *resampleFilterName(ResampleFilter filter);
+
+// Box-filter decimation: every destination pixel is the rounded mean of a
+// horizontal x vertical block of source pixels. The destination must be
+// source.width / horizontal by source.height / vertical; columns and rows
+// left over at the right and bottom edges are dropped, as in decimateImageEven.
+void decimateBox(const ImageView &source, const MutableImageView &destination, int horizontal, int vertical);
+
+// Separable resampling to the size of destination, for any ratio either way.
+// Each destination row and column takes a precomputed set of 14-bit fixed-point
+// taps centred on its position in the source; when shrinking, the filter is
+// widened by the ratio so it still averages every covered source pixel. Taps
+// beyond the edges are dropped and the others renormalised.
+void resample(const ImageView &source, const MutableImageView &destination, ResampleFilter filter);
+
+#endif //BMPANALYZER_RESAMPLE_H
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstring>
+#include "rle.h"
+#include "simd.h"
+
+namespace {
+    // Writes count copies of a 3-byte pixel. Runs are stored 16 pixels (three
+    // 16-byte vectors) at a time from a pattern built once per run.
+    void fillPixels(uint8_t *out, const uint8_t *color, size_t count) {
+        uint8_t pattern[48];
+        for (int i = 0; i < 48; i += 3) {
+            std::memcpy(pattern + i, color, 3);
+        }
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            std::memcpy(out + i * 3, pattern, 48);
+        }
+        std::memcpy(out + i * 3, pattern, (count - i) * 3);
+    }
+
+    // Length of the run of bytes equal to p[0], at most limit.
+    size_t runLength(const uint8_t *p, size_t limit) {
+        size_t length = 1;
+#ifdef BMP_SSE41
+        const __m128i value = _mm_set1_epi8(static_cast<char>(p[0]));
+        while (length + 16 <= limit) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + length));
+            auto equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, value)));
+            if (equal != 0xFFFF) {
+                unsigned different = ~equal & 0xFFFF;
+                unsigned offset = 0;
+                while (!(different >> offset & 1)) {
+                    ++offset;
+                }
+                return length + offset;
+            }
+            length += 16;
+        }
+#endif
+        while (length < limit && p[length] == p[0]) {
+            ++length;
+        }
+        return length;
+    }
+}
+
+void decodeRleToBgr24(uint32_t compression, const std::vector<uint8_t> &colors,
+                      const uint8_t *source, size_t size,
+                      uint8_t *destination, size_t destinationStride, size_t width, size_t height) {
+    uint8_t table[256][4]{};
+    std::memcpy(table, colors.data(), std::min(colors.size(), sizeof(table)));
+
+    bool rle4 = compression == compressionRle4;
+    const uint8_t *end = source + size;
+    const uint8_t *p = source;
+    size_t x = 0;
+    size_t y = 0;
+
+    while (p + 2 <= end && y < height) {
+        uint8_t count = p[0];
+        uint8_t value = p[1];
+        p += 2;
+        uint8_t *row = destination + y * destinationStride;
+
+        if (count > 0) {
+            size_t n = std::min<size_t>(count, width - std::min(x, width));
+            if (!rle4) {
+                fillPixels(row + x * 3, table[value], n);
+            } else {
+                // the two nibbles alternate, starting with the high one
+                for (size_t i = 0; i < n; ++i) {
+                    std::memcpy(row + (x + i) * 3, table[i % 2 == 0 ? value >> 4 : value & 0x0F], 3);
+                }
+            }
+            x += count;
+            continue;
+        }
+
+        switch (value) {
+            case 0: // end of line
+                x = 0;
+                ++y;
+                break;
+            case 1: // end of bitmap
+                return;
+            case 2: // delta
+                if (p + 2 > end) {
+                    return;
+                }
+                x += p[0];
+                y += p[1];
+                p += 2;
+                break;
+            default: { // absolute run of value pixels, padded to a 16-bit boundary
+                size_t bytes = rle4 ? (value + 1) / 2 : value;
+                if (p + bytes > end) {
+                    return;
+                }
+                size_t n = std::min<size_t>(value, width - std::min(x, width));
+                for (size_t i = 0; i < n; ++i) {
+                    uint8_t index = rle4 ? (i % 2 == 0 ? p[i / 2] >> 4 : p[i / 2] & 0x0F) : p[i];
+                    std::memcpy(row + (x + i) * 3, table[index], 3);
+                }
+                x += value;
+                p += bytes + (bytes & 1);
+                break;
+            }
+        }
+    }
+}
+
+void appendRle8Row(const uint8_t *row, size_t width, std::vector<uint8_t> &encoded) {
+    size_t x = 0;
+    while (x < width) {
+        size_t run = runLength(row + x, std::min<size_t>(255, width - x));
+        if (run >= 2) {
+            encoded.push_back(static_cast<uint8_t>(run));
+            encoded.push_back(row[x]);
+            x += run;
+            continue;
+        }
+
+        // literal bytes up to the next run of three equal ones
+        size_t literal = 0;
+        while (x + literal < width && literal < 255) {
+            size_t next = x + literal;
+            if (next + 2 < width && row[next] == row[next + 1] && row[next] == row[next + 2]) {
+                break;
+            }
+            ++literal;
+        }
+        if (literal < 3) {
+            // absolute mode needs at least three pixels
+            for (size_t i = 0; i < literal; ++i) {
+                encoded.push_back(1);
+                encoded.push_back(row[x + i]);
+            }
+        } else {
+            encoded.push_back(0);
+            encoded.push_back(static_cast<uint8_t>(literal));
+            encoded.insert(encoded.end(), row + x, row + x + literal);
+            if (literal % 2 != 0) {
+                encoded.push_back(0);
+            }
+        }
+        x += literal;
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef BMPANALYZER_RLE_H
+#define BMPANALYZER_RLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// biCompression values of run-length encoded images.
+const uint32_t compressionRle8 = 1;
+const uint32_t compressionRle4 = 2;
+
+// Decodes BI_RLE8 or BI_RLE4 data straight into 24-bit BGR rows (in file row
+// order) through a BGRX colour table. Pixels skipped by delta or end-of-line
+// codes stay as they are; malformed data never writes outside the image.
+void decodeRleToBgr24(uint32_t compression, const std::vector<uint8_t> &colors,
+                      const uint8_t *source, size_t size,
+                      uint8_t *destination, size_t destinationStride, size_t width, size_t height);
+
+// Appends one row of 8-bit indices as BI_RLE8 runs, without the end-of-line code.
+void appendRle8Row(const uint8_t *row, size_t width, std::vector<uint8_t> &encoded);
+
+#endif //BMPANALYZER_RLE_H
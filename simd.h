@@ -0,0 +1,18 @@
+#ifndef BMPANALYZER_SIMD_H
+#define BMPANALYZER_SIMD_H
+
+// Instruction sets the kernels may use, decided at compile time by the target
+// flags (see BMP_NATIVE_ARCH). MSVC only reports __AVX2__, which implies SSE4.1.
+// BMP_NO_SIMD keeps every kernel on its scalar path (see SimdCheck).
+
+#if defined(__AVX2__) && !defined(BMP_NO_SIMD)
+#define BMP_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if (defined(__SSE4_1__) || defined(__AVX2__)) && !defined(BMP_NO_SIMD)
+#define BMP_SSE41 1
+#include <smmintrin.h>
+#endif
+
+#endif //BMPANALYZER_SIMD_H
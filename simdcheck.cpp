@@ -0,0 +1,147 @@
+// Runs the SIMD-dispatched kernels on odd-sized images and prints their exact
+// results. CMake builds it once against the normal library and once against
+// a BMP_NO_SIMD copy; the test passes when both print the same.
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "colorconvert.h"
+#include "planarimage.h"
+#include "quality.h"
+#include "resample.h"
+#include "stats.h"
+
+namespace {
+    struct Image {
+        size_t width;
+        size_t height;
+        size_t stride;
+        std::vector<uint8_t> data;
+
+        Image(size_t width, size_t height, size_t padding)
+                : width(width), height(height), stride(width * 3 + padding), data(stride * height) {}
+
+        ImageView view() const {
+            return {data.data(), width, height, stride};
+        }
+
+        MutableImageView view() {
+            return {data.data(), width, height, stride};
+        }
+    };
+
+    // Mostly noise, with flat runs and saturated pixels that sit on the rounding edges.
+    Image randomImage(size_t width, size_t height, size_t padding, uint32_t seed) {
+        std::mt19937 generator(seed);
+        Image image(width, height, padding);
+        for (size_t i = 0; i < image.data.size(); ++i) {
+            uint32_t value = generator();
+            image.data[i] = value % 7 == 0 ? (value % 2 ? 255 : 0) : static_cast<uint8_t>(value >> 8);
+            if (i > 0 && value % 5 == 0) {
+                image.data[i] = image.data[i - 1];
+            }
+        }
+        return image;
+    }
+
+    // FNV-1a over the pixels of a view, padding excluded.
+    uint64_t hashPixels(const ImageView &image) {
+        uint64_t hash = 1469598103934665603ull;
+        for (size_t y = 0; y < image.height; ++y) {
+            const uint8_t *row = image.row(y);
+            for (size_t x = 0; x < image.width * 3; ++x) {
+                hash = (hash ^ row[x]) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    void printStats(std::ostream &out, const StatsAccumulator &stats) {
+        out << stats.count;
+        for (int c = 0; c < 3; ++c) {
+            out << ' ' << stats.sum[c];
+            for (int d = c; d < 3; ++d) {
+                out << ' ' << stats.sumProduct[c][d];
+            }
+        }
+        out << '\n';
+    }
+
+    std::string hexDouble(double value) {
+        char text[64];
+        std::snprintf(text, sizeof(text), "%a", value);
+        return text;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: SimdCheck <output.txt>" << std::endl;
+        return 1;
+    }
+    std::ostringstream out;
+    const size_t sizes[][3] = {{1, 1, 0}, {3, 5, 1}, {17, 9, 3}, {31, 33, 1}, {67, 41, 2}, {259, 37, 3}, {1001, 7, 0}};
+
+    uint32_t seed = 1;
+    for (const auto &size: sizes) {
+        Image image = randomImage(size[0], size[1], size[2], seed++);
+        Image other = randomImage(size[0], size[1], size[2], seed++);
+        out << "image " << size[0] << 'x' << size[1] << '\n';
+
+        StatsAccumulator stats;
+        stats.update(image.view());
+        out << "stats ";
+        printStats(out, stats);
+
+        PlanarImage planar = PlanarImage::deinterleave(image.data.data(), static_cast<int>(image.width),
+                                                       static_cast<int>(image.height), image.stride);
+        StatsAccumulator planarStats;
+        planarStats.update(planar.channel(0), planar.channel(1), planar.channel(2));
+        out << "planar stats ";
+        printStats(out, planarStats);
+
+        ErrorAccumulator errors;
+        errors.update(image.view(), other.view());
+        out << "errors " << errors.count << ' ' << errors.sumSquares[0] << ' ' << errors.sumSquares[1] << ' '
+            << errors.sumSquares[2] << '\n';
+
+        std::vector<uint8_t> converted(image.width * 3);
+        std::vector<uint8_t> restored(image.width * 3);
+        convertRGBToYCbCrPixels(image.view().row(0), converted.data(), image.width);
+        convertYCbCrToRGBPixels(converted.data(), restored.data(), image.width);
+        out << "color " << hashPixels(ImageView(converted.data(), image.width, 1, converted.size())) << ' '
+            << hashPixels(ImageView(restored.data(), image.width, 1, restored.size())) << '\n';
+
+        for (int factor: {2, 3}) {
+            Image decimated(image.width / factor, image.height / factor, 1);
+            decimateBox(image.view(), decimated.view(), factor, factor);
+            out << "box " << factor << ' ' << hashPixels(decimated.view()) << '\n';
+        }
+
+        for (ResampleFilter filter: {ResampleFilter::Bilinear, ResampleFilter::Bicubic, ResampleFilter::Lanczos3}) {
+            const size_t targets[][2] = {{size[0] * 2 + 1, size[1] * 3}, {size[0] / 2 + 1, size[1] / 3 + 1},
+                                         {size[0] + 5, size[1] / 2 + 1}};
+            for (const auto &target: targets) {
+                Image resampled(target[0], target[1], 2);
+                resample(image.view(), resampled.view(), filter);
+                out << "resample " << resampleFilterName(filter) << ' ' << target[0] << 'x' << target[1] << ' '
+                    << hashPixels(resampled.view()) << '\n';
+            }
+        }
+
+        if (image.width >= 8 && image.height >= 8) {
+            out << "ssim " << hexDouble(countSSIM(image.view().channel(1), other.view().channel(1))) << '\n';
+        }
+    }
+
+    std::ofstream file(argv[1]);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << argv[1] << std::endl;
+        return 1;
+    }
+    file << out.str();
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "bmp.h"
+#include "planarimage.h"
+#include "simd.h"
+#include "stats.h"
+
+double ChannelStats::meanOf(char component) const {
+    return mean[getIndexComponent(component)];
+}
+
+double ChannelStats::varianceOf(char component) const {
+    return variance[getIndexComponent(component)];
+}
+
+double ChannelStats::standardDeviationOf(char component) const {
+    return standardDeviation[getIndexComponent(component)];
+}
+
+double ChannelStats::covarianceOf(char component1, char component2) const {
+    return covariance[getIndexComponent(component1)][getIndexComponent(component2)];
+}
+
+double ChannelStats::correlationOf(char component1, char component2) const {
+    return correlation[getIndexComponent(component1)][getIndexComponent(component2)];
+}
+
+namespace {
+    // Pixels per plane chunk when the input is not already planar.
+    const size_t chunk = 512;
+
+    // Pairs (i, j) of the products kept in StatsAccumulator::sumProduct, in that order.
+    const int productPairs[6][2] = {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 2}};
+
+    // Adds the sums and pairwise product sums of three planes. Byte sums are
+    // widened straight to 64-bit lanes (sad_epu8), products are summed in pairs
+    // into 32-bit lanes (madd_epi16) and moved to 64 bits before they can
+    // overflow, so the totals are exact whatever the order of the blocks.
+    void sumPlanes(const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, size_t count,
+                   uint64_t (&sums)[3], uint64_t (&products)[6]) {
+        size_t i = 0;
+#ifdef BMP_SSE41
+        const uint8_t *planes[3] = {c0, c1, c2};
+        const __m128i zero = _mm_setzero_si128();
+        // a block adds at most 4 * 255^2 to a 32-bit lane
+        const size_t blocksPerFlush = 8192;
+        __m128i sum64[3] = {zero, zero, zero};
+
+        while (i + 16 <= count) {
+            size_t blocks = std::min((count - i) / 16, blocksPerFlush);
+#ifdef BMP_AVX2
+            __m256i product32[6];
+            for (auto &lanes: product32) {
+                lanes = _mm256_setzero_si256();
+            }
+#else
+            __m128i product32[6] = {zero, zero, zero, zero, zero, zero};
+#endif
+            for (size_t block = 0; block < blocks; ++block, i += 16) {
+                __m128i v[3];
+                for (int c = 0; c < 3; ++c) {
+                    v[c] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes[c] + i));
+                    sum64[c] = _mm_add_epi64(sum64[c], _mm_sad_epu8(v[c], zero));
+                }
+#ifdef BMP_AVX2
+                __m256i wide[3];
+                for (int c = 0; c < 3; ++c) {
+                    wide[c] = _mm256_cvtepu8_epi16(v[c]);
+                }
+                for (int p = 0; p < 6; ++p) {
+                    __m256i product = _mm256_madd_epi16(wide[productPairs[p][0]], wide[productPairs[p][1]]);
+                    product32[p] = _mm256_add_epi32(product32[p], product);
+                }
+#else
+                __m128i low[3];
+                __m128i high[3];
+                for (int c = 0; c < 3; ++c) {
+                    low[c] = _mm_unpacklo_epi8(v[c], zero);
+                    high[c] = _mm_unpackhi_epi8(v[c], zero);
+                }
+                for (int p = 0; p < 6; ++p) {
+                    int a = productPairs[p][0];
+                    int b = productPairs[p][1];
+                    __m128i product = _mm_add_epi32(_mm_madd_epi16(low[a], low[b]), _mm_madd_epi16(high[a], high[b]));
+                    product32[p] = _mm_add_epi32(product32[p], product);
+                }
+#endif
+            }
+            for (int p = 0; p < 6; ++p) {
+                uint32_t lanes[sizeof(product32[p]) / 4];
+                std::memcpy(lanes, &product32[p], sizeof(lanes));
+                for (uint32_t lane: lanes) {
+                    products[p] += lane;
+                }
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            uint64_t lanes[2];
+            std::memcpy(lanes, &sum64[c], sizeof(lanes));
+            sums[c] += lanes[0] + lanes[1];
+        }
+#endif
+        for (; i < count; ++i) {
+            uint32_t v[3] = {c0[i], c1[i], c2[i]};
+            for (int c = 0; c < 3; ++c) {
+                sums[c] += v[c];
+            }
+            for (int p = 0; p < 6; ++p) {
+                products[p] += v[productPairs[p][0]] * v[productPairs[p][1]];
+            }
+        }
+    }
+}
+
+void StatsAccumulator::update(const uint8_t *pixels, size_t pixelCount) {
+    // interleaved pixels are split into small planes that stay in L1
+    alignas(16) uint8_t planes[3][chunk];
+    for (size_t first = 0; first < pixelCount; first += chunk) {
+        size_t n = std::min(chunk, pixelCount - first);
+        deinterleavePixels(pixels + first * 3, planes[0], planes[1], planes[2], n);
+        updatePlanes(planes[0], planes[1], planes[2], n);
+    }
+}
+
+void StatsAccumulator::update(const ImageView &image) {
+    if (image.contiguous()) {
+        update(image.data, image.count());
+        return;
+    }
+    for (size_t y = 0; y < image.height; ++y) {
+        update(image.row(y), image.width);
+    }
+}
+
+void StatsAccumulator::update(const ChannelView &c0, const ChannelView &c1, const ChannelView &c2) {
+    const ChannelView *views[3] = {&c0, &c1, &c2};
+    for (const ChannelView *view: views) {
+        if (view->width != c0.width || view->height != c0.height) {
+            throw std::runtime_error("Channel views differ in size");
+        }
+    }
+    // rows are gathered into small planes, unless every view already is one
+    alignas(16) uint8_t planes[3][chunk];
+    for (size_t y = 0; y < c0.height; ++y) {
+        for (size_t first = 0; first < c0.width; first += chunk) {
+            size_t n = std::min(chunk, c0.width - first);
+            const uint8_t *rows[3];
+            for (int c = 0; c < 3; ++c) {
+                const ChannelView &view = *views[c];
+                rows[c] = view.data + y * view.rowStride + first * view.step;
+                if (view.step != 1) {
+                    for (size_t x = 0; x < n; ++x) {
+                        planes[c][x] = rows[c][x * view.step];
+                    }
+                    rows[c] = planes[c];
+                }
+            }
+            updatePlanes(rows[0], rows[1], rows[2], n);
+        }
+    }
+}
+
+void StatsAccumulator::updatePlanes(const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, size_t pixelCount) {
+    uint64_t products[6]{};
+    sumPlanes(c0, c1, c2, pixelCount, sum, products);
+
+    count += pixelCount;
+    for (int p = 0; p < 6; ++p) {
+        sumProduct[productPairs[p][0]][productPairs[p][1]] += products[p];
+    }
+}
+
+void StatsAccumulator::merge(const StatsAccumulator &other) {
+    count += other.count;
+    for (int i = 0; i < 3; ++i) {
+        sum[i] += other.sum[i];
+        for (int j = i; j < 3; ++j) {
+            sumProduct[i][j] += other.sumProduct[i][j];
+        }
+    }
+}
+
+ChannelStats StatsAccumulator::finalize() const {
+    ChannelStats stats;
+    stats.count = count;
+    if (count == 0) {
+        return stats;
+    }
+
+    auto n = static_cast<double>(count);
+    for (int i = 0; i < 3; ++i) {
+        stats.mean[i] = static_cast<double>(sum[i]) / n;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = i; j < 3; ++j) {
+            double centered = static_cast<double>(sumProduct[i][j]) -
+                              static_cast<double>(sum[i]) * static_cast<double>(sum[j]) / n;
+            double covariance = count > 1 ? centered / (n - 1) : 0;
+            stats.covariance[i][j] = covariance;
+            stats.covariance[j][i] = covariance;
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        stats.variance[i] = stats.covariance[i][i];
+        stats.standardDeviation[i] = std::sqrt(stats.variance[i]);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            double deviations = stats.standardDeviation[i] * stats.standardDeviation[j];
+            stats.correlation[i][j] = deviations > 0 ? stats.covariance[i][j] / deviations : 0;
+        }
+    }
+    return stats;
+}
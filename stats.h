@@ -0,0 +1,54 @@
+#ifndef BMPANALYZER_STATS_H
+#define BMPANALYZER_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "channelview.h"
+#include "imageview.h"
+
+// Statistics of all three channels of an interleaved image, indexed by the
+// byte position of the channel inside a pixel (see getIndexComponent).
+struct ChannelStats {
+    uint64_t count = 0;
+    double mean[3]{};
+    double variance[3]{};
+    double standardDeviation[3]{};
+    double covariance[3][3]{};
+    double correlation[3][3]{};
+
+    double meanOf(char component) const;
+
+    double varianceOf(char component) const;
+
+    double standardDeviationOf(char component) const;
+
+    double covarianceOf(char component1, char component2) const;
+
+    double correlationOf(char component1, char component2) const;
+};
+
+// Exact integer sums of three channels, collected in a single pass; everything
+// in ChannelStats derives from them. Accumulators filled from separate tiles,
+// bands, threads or files merge into the same totals in any order.
+struct StatsAccumulator {
+    uint64_t count = 0;
+    uint64_t sum[3]{};
+    uint64_t sumProduct[3][3]{}; // only the upper triangle is accumulated
+
+    // Adds pixelCount interleaved 3-byte pixels.
+    void update(const uint8_t *pixels, size_t pixelCount);
+
+    void update(const ImageView &image);
+
+    // Same as update for pixels stored as three separate planes.
+    void updatePlanes(const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, size_t pixelCount);
+
+    // Treats three views of the same size, possibly of different images, as the channels.
+    void update(const ChannelView &c0, const ChannelView &c1, const ChannelView &c2);
+
+    void merge(const StatsAccumulator &other);
+
+    ChannelStats finalize() const;
+};
+
+#endif //BMPANALYZER_STATS_H
@@ -0,0 +1,182 @@
+#include <cstdlib>
+#include <exception>
+#include "threadpool.h"
+
+namespace {
+    // Bands of about 256 KB keep per-band overhead small and give every thread
+    // several bands to balance on.
+    const size_t targetBandBytes = size_t{1} << 18;
+
+    thread_local const ThreadPool *currentPool = nullptr;
+    thread_local size_t currentQueue = 0;
+
+    std::mutex instanceMutex;
+    std::unique_ptr<ThreadPool> sharedPool;
+
+    unsigned defaultThreadCount() {
+        if (const char *value = std::getenv("BMP_THREADS")) {
+            int threads = std::atoi(value);
+            if (threads > 0) {
+                return static_cast<unsigned>(threads);
+            }
+        }
+        unsigned hardware = std::thread::hardware_concurrency();
+        return hardware > 0 ? hardware : 1;
+    }
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    size_t workerCount = threadCount > 1 ? threadCount - 1 : 0;
+    for (size_t i = 0; i <= workerCount; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::push(Task task) {
+    Queue &queue = *queues[nextQueue++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    ++pending;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runOne(size_t preferred) {
+    for (size_t k = 0; k < queues.size(); ++k) {
+        Queue &queue = *queues[(preferred + k) % queues.size()];
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            // own queue from the front, victims from the back
+            if (k == 0) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            } else {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+        }
+        --pending;
+        task();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentQueue = index;
+
+    while (true) {
+        if (runOne(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait(lock, [this] { return stopping || pending > 0; });
+        if (stopping && pending == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &task) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || workers.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    struct Job {
+        std::atomic<size_t> remaining{0};
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+    auto job = std::make_shared<Job>();
+    job->remaining = count;
+
+    for (size_t i = 0; i < count; ++i) {
+        push([job, &task, i] {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                if (!job->error) {
+                    job->error = std::current_exception();
+                }
+            }
+            if (--job->remaining == 0) {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->done.notify_all();
+            }
+        });
+    }
+
+    // help instead of blocking, this also keeps nested calls from deadlocking
+    size_t self = currentPool == this ? currentQueue : queues.size() - 1;
+    while (job->remaining > 0) {
+        if (!runOne(self)) {
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->done.wait(lock, [&job] { return job->remaining == 0; });
+        }
+    }
+
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+ThreadPool &ThreadPool::instance() {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (!sharedPool) {
+        sharedPool = std::make_unique<ThreadPool>(defaultThreadCount());
+    }
+    return *sharedPool;
+}
+
+void ThreadPool::setThreadCount(unsigned threadCount) {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    sharedPool = std::make_unique<ThreadPool>(threadCount > 0 ? threadCount : defaultThreadCount());
+}
+
+size_t bandRowsFor(size_t rowBytes) {
+    return std::max<size_t>(1, targetBandBytes / std::max<size_t>(rowBytes, 1));
+}
+
+size_t bandCount(size_t rows, size_t rowBytes) {
+    size_t bandRows = bandRowsFor(rowBytes);
+    return (rows + bandRows - 1) / bandRows;
+}
+
+void parallelRows(size_t rows, size_t rowBytes, const std::function<void(size_t, size_t)> &function) {
+    size_t bandRows = bandRowsFor(rowBytes);
+    ThreadPool::instance().parallelFor(bandCount(rows, rowBytes), [&](size_t band) {
+        size_t first = band * bandRows;
+        function(first, std::min(rows, first + bandRows));
+    });
+}
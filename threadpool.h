@@ -0,0 +1,93 @@
+#ifndef BMPANALYZER_THREADPOOL_H
+#define BMPANALYZER_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool shared by all kernels. Every worker owns a task deque,
+// takes work from its front and steals from the back of the others when it
+// runs dry. A thread waiting in parallelFor runs pending tasks itself, so
+// kernels may call parallelFor from inside a task.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Number of threads working on a parallelFor, including the caller.
+    unsigned size() const {
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    // Runs task(i) for every i in [0, count) and returns when all calls have finished.
+    void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+    // The shared pool, sized from BMP_THREADS or the hardware concurrency.
+    static ThreadPool &instance();
+
+    // Replaces the shared pool; must not be called while it is running tasks.
+    static void setThreadCount(unsigned threadCount);
+
+private:
+    using Task = std::function<void()>;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task);
+
+    bool runOne(size_t preferred);
+
+    void workerLoop(size_t index);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker plus one for outside callers
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> nextQueue{0};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+// Splits rows into bands whose size depends only on the row size, never on the
+// thread count, and runs function(firstRow, endRow) for every band in parallel.
+// Reductions that combine per-band results in band order are therefore
+// deterministic for any number of threads.
+size_t bandRowsFor(size_t rowBytes);
+
+size_t bandCount(size_t rows, size_t rowBytes);
+
+void parallelRows(size_t rows, size_t rowBytes, const std::function<void(size_t, size_t)> &function);
+
+// Computes one partial result per band and merges them in band order.
+template<typename Result, typename Partial, typename Merge>
+Result reduceRows(size_t rows, size_t rowBytes, Partial partial, Merge merge) {
+    size_t bandRows = bandRowsFor(rowBytes);
+    std::vector<Result> results(bandCount(rows, rowBytes));
+    ThreadPool::instance().parallelFor(results.size(), [&](size_t band) {
+        size_t first = band * bandRows;
+        results[band] = partial(first, std::min(rows, first + bandRows));
+    });
+
+    Result total{};
+    for (const auto &result: results) {
+        merge(total, result);
+    }
+    return total;
+}
+
+#endif //BMPANALYZER_THREADPOOL_H